@@ -11,3 +11,24 @@ void setAllLEDs(CHSV c, CRGB* strip, uint16_t numLeds) {
     strip[i] = c;
   }
 }
+
+#ifdef MW_REPLAY
+#include <util/crc16.h>
+
+uint16_t checksumLEDs(uint16_t crc, const CRGB* strip, uint16_t numLeds) {
+  const uint8_t* bytes = (const uint8_t*)strip;
+  for (uint16_t i = 0; i < numLeds * sizeof(CRGB); ++i) {
+    crc = _crc16_update(crc, bytes[i]);
+  }
+  return crc;
+}
+
+uint16_t checksumColor(uint16_t crc, const CRGB& color, uint16_t numLeds) {
+  for (uint16_t i = 0; i < numLeds; ++i) {
+    crc = _crc16_update(crc, color.r);
+    crc = _crc16_update(crc, color.g);
+    crc = _crc16_update(crc, color.b);
+  }
+  return crc;
+}
+#endif
@@ -1,3 +1,6 @@
+#include "config.h"
+#define USE_GET_MILLISECOND_TIMER // make FastLED's timing functions (beatsin8, etc.) run off the frame clock, see clock.h
+
 #include <SPI.h>
 #include <MFRC522.h>
 #include <FastLED.h>
@@ -7,166 +10,208 @@ using namespace ace_button;
 #include "MW3_PIN_LAYOUT.h"
 #include "config.h"
 #include "lights.h"
+#include "lightRegistry.h"
 #include "buttons.h"
+#include "log.h"
 #include "rfid.h"
+#include "tagFormat.h"
+#include "tagCache.h"
+#include "tagReader.h"
+#include "serialControl.h"
+#include "scheduler.h"
+#include "benchmark.h"
+#include "profiler.h"
+#include "replay.h"
 
 MFRC522 rfid(MW_SPI_CS, UINT8_MAX); // RST pin (NRSTPD on MFRC522) not connected; setting it to this will let the library switch to using soft reset only
-
-PatternLightLEDStrip<MW_STRIP_0_DATA, MW_STRIP_1_DATA> windows(NUM_LEDS_WINDOWS);
-PatternLightLEDStrip<MW_STRIP_2_DATA, MW_STRIP_3_DATA> groundLights(NUM_LEDS_GROUNDLIGHTS);
+TagReader tagReader(rfid);
+TagCache tagCache;
+
+typedef StripLayout<Strip<MW_STRIP_0_DATA, NUM_LEDS_WINDOWS>, Strip<MW_STRIP_1_DATA, NUM_LEDS_WINDOWS>> WindowsLayout;
+// ground lights: a side, then the back; strip 2 is one side, strip 3 is the other side followed by the back
+typedef StripLayout<Strip<MW_STRIP_2_DATA, NUM_LEDS_GROUNDLIGHTS_SIDE>,
+                    MappedStrip<MW_STRIP_3_DATA, Segment<0, NUM_LEDS_GROUNDLIGHTS_SIDE>, Segment<NUM_LEDS_GROUNDLIGHTS_SIDE, NUM_LEDS_GROUNDLIGHTS_BACK>>> GroundLightsLayout;
+// moat: the center, with both sides mirroring its top
+typedef StripLayout<Strip<MW_STRIP_5_DATA, NUM_LEDS_WATERFALL_CENTER>, Strip<MW_STRIP_6_DATA, NUM_LEDS_WATERFALL_SIDES>, Strip<MW_STRIP_7_DATA, NUM_LEDS_WATERFALL_SIDES>> MoatLayout;
+typedef LEDArena<WindowsLayout, GroundLightsLayout, MoatLayout> LightsArena;
+
+PatternLightLEDStrip<WindowsLayout> windows(LightsArena::buffer<0>());
+PatternLightLEDStrip<GroundLightsLayout> groundLights(LightsArena::buffer<1>());
 FairyLightsController fairyLights(MW_STRIP_4_DATA);
-PatternLightLEDStrip<MW_STRIP_5_DATA, MW_STRIP_6_DATA, MW_STRIP_7_DATA> moat(NUM_LEDS_WATERFALL_CENTER, NUM_LEDS_WATERFALL_SIDES, NUM_LEDS_WATERFALL_SIDES);
+PatternLightLEDStrip<MoatLayout> moat(LightsArena::buffer<2>());
 PatternLightPWMPort starfield(MW_5V_OUT_1);
 
-ILight *lights[] = {&windows, &groundLights, & fairyLights, &moat, &starfield};
-extern const byte NUM_LIGHTOBJECTS = sizeof(lights) / sizeof(void *);
+typedef LightRegistry<LIGHT_ENTRY(windows), LIGHT_ENTRY(groundLights), LIGHT_ENTRY(fairyLights), LIGHT_ENTRY(moat), LIGHT_ENTRY(starfield)> Lights;
+ILight** const lights = Lights::interfaces;
+extern const byte NUM_LIGHTOBJECTS = Lights::count;
 
-static const byte defaultLightConfiguration[][15] = {
-  {0x06, 0x1E, 0xFF, 0x05, 0x48, 0xFF, 0x02, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x02, 0x00, 0x00},
-  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}
+SerialControl serialControl(lights, NUM_LIGHTOBJECTS);
+
+static const byte defaultLightConfiguration[][16] = { // legacy tag format, see tagFormat.h
+  {0x06, 0x1E, 0xFF, 0x05, 0x48, 0xFF, 0x02, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x02, 0x00, 0x00, 0xFF},
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF},
+  {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF}
 };
 
 byte whichObject = 0;
 
+// per light steps of setup() and renderFrame(), called on each light as its own type, see lightRegistry.h
+struct SetupLight
+{
+  template <typename L>
+  void operator()(L& ioLight, byte iIndex) { ioLight.setup(); }
+};
+
+struct UpdateLight
+{
+  template <typename L>
+  void operator()(L& ioLight, byte iIndex)
+  {
+    ioLight.update();
+    PROFILE_MARK(PROFILE_STAGE_UPDATE(iIndex));
+  }
+};
+
+struct ShowLight
+{
+  bool shown = false;
+
+  template <typename L>
+  void operator()(L& ioLight, byte iIndex)
+  {
+    shown |= ioLight.show(); // profiled by the light, per LED controller
+  }
+};
+
+void applyDefaultSettings();
+void renderFrame();
+void runButtons();
+void runRFID();
+void runSerial();
+void debug_printFPS();
+
+// task indices (as logged by LOG_TASK_LATE) are their position here
+Task tasks[] = {
+  Task(renderFrame, MW_FRAME_INTERVAL, MW_TASK_DEADLINE, TASK_PRIORITY_HIGH),
+  Task(runButtons, 0, MW_TASK_DEADLINE, TASK_PRIORITY_NORMAL),
+  Task(runRFID, 0, MW_TASK_DEADLINE, TASK_PRIORITY_BACKGROUND),
+  Task(runSerial, 0, MW_TASK_DEADLINE, TASK_PRIORITY_BACKGROUND),
+  // Task(debug_printFPS, 1000, 0, TASK_PRIORITY_BACKGROUND),
+};
+Scheduler scheduler(tasks, sizeof(tasks) / sizeof(tasks[0]));
+
 void setup()
 {
+  tickClock();
+  PROFILE_SETUP();
   setupButtons();
 
   SPI.begin();
   rfid.PCD_Init();
+  tagCache.setup();
 
-  for (byte i = 0; i < NUM_LIGHTOBJECTS; ++i)
-  {
-    lights[i]->setup();
-  }
+  SetupLight setupLight;
+  Lights::forEach(setupLight);
 
   FastLED.setBrightness(BRIGHTNESS);
   groundLights.setMaxBrightness(210);
-  FastLED.setMaxRefreshRate(60); // 60 FPS cap
   FastLED.clear();
 
   Serial.begin(115200);
   Serial.print("MW3 ready; ");
   Serial.print(NUM_LIGHTOBJECTS);
-  Serial.println(" lights available.");
+  Serial.print(" lights available, ");
+  Serial.print(LightsArena::bytes);
+  Serial.println(" bytes of LED buffers.");
+
+#ifdef MW_BENCHMARK
+  runBenchmarks();
+#endif
 
   FastLED.show();
 
+  scheduler.setup();
+
   // pulse the selected light, also serves as a boot up complete indicator
   lights[whichObject]->pulse();
 
   applyDefaultSettings();
+
+#ifdef MW_REPLAY
+  runReplay<Lights>(); // never returns
+#endif
 };
 
 void debug_printFPS()
 {
-  static uint16_t prevDebugOut = millis();
-  uint16_t now = millis();
-  if ((uint16_t)(now - prevDebugOut) >= 1000)
-  {
-    Serial.println(FastLED.getFPS());
-    prevDebugOut = now;
-  }
+  Serial.println(FastLED.getFPS());
 };
 
-void writeLightSettingsToTag()
+void writeLightSettingsToTag(ReaderSession& ioSession)
 {
-  // reserve space for up to 15 lights:
-  // - 3 data blocks of 16 bytes each
-  // - each light is encoded over 3 bytes, so up to 5 lights per block, and a padding value in the last byte of the block
   byte lightsDataBuffer[MW_RFID_DATA_BLOCK_COUNT][16];
-  memset8(lightsDataBuffer, 0, sizeof(lightsDataBuffer));
-  for (byte i = 0; i < 3; ++i)
-    lightsDataBuffer[i][15] = 0xFF;
+  byte numBlocks = encodeTag(lights, NUM_LIGHTOBJECTS, lightsDataBuffer[0]);
 
-  for (byte lightIdx = 0; lightIdx < NUM_LIGHTOBJECTS; ++lightIdx)
-  {
-    lights[lightIdx]->serialize(&((LightDataBlock*)(lightsDataBuffer[lightIdx / 5]))[lightIdx % 5]);
-  }
+  for (byte i = 0; i < numBlocks; ++i)
+    logEvent(LOG_TAG_WRITE_BLOCK, i, LogBytes{lightsDataBuffer[i], 16});
 
-  for (byte i = 0; i < MW_RFID_DATA_BLOCK_COUNT; ++i)
-  {
-    Serial.print("lightsData block #"); Serial.print(i); Serial.println(" is:");
-    dump_byte_array(lightsDataBuffer[i], 16); Serial.println();
-  }
-  
-  Serial.println("Writing data to tag...");
-  for (byte block = 0; block < MW_RFID_DATA_BLOCK_COUNT; ++block)
+  logEvent(LOG_TAG_WRITING);
+  MFRC522::StatusCode ret = ioSession.writeBlocks(MW_RFID_DATA_BLOCK_ADDR, numBlocks, lightsDataBuffer[0], true); // writes are rare enough to always verify them
+  if (ret != MFRC522::STATUS_OK)
   {
-    MFRC522::StatusCode ret = writeBlock(rfid, MW_RFID_DATA_BLOCK_ADDR + block, lightsDataBuffer[block]);
-    if (ret != MFRC522::STATUS_OK)
-    {
-      Serial.print(F("Internal failure while writing to tag: "));
-      Serial.println(rfid.GetStatusCodeName(ret));
-      return;
-    }
+    logEvent(LOG_TAG_WRITE_FAILED, ret);
+    return;
   }
+  if (rfidWriteOnce)
+    rfidWrite = rfidWriteOnce = false;
 
-  Serial.println("Wrote lights data to tag.");
-};
-
-void readLightSettingsFromTag()
-{
-  byte buffer[18]; // minimum of 16 (size of a block) + 2 (CRC)
-  byte size = sizeof(buffer);
-
-  for (byte blockOffset = 0; blockOffset < MW_RFID_DATA_BLOCK_COUNT; ++blockOffset)
-  {
-    byte blockAddr = MW_RFID_DATA_BLOCK_ADDR + blockOffset;
-    // Serial.print("Trying to read block #"); Serial.print(blockAddr); Serial.print(" (because MW_RFID_DATA_BLOCK_ADDR="); Serial.print(MW_RFID_DATA_BLOCK_ADDR); Serial.print(" + blockOffset="); Serial.print(blockOffset); Serial.println(")");
-    MFRC522::StatusCode ret = readBlock(rfid, blockAddr, buffer, &size);
-    if (ret != MFRC522::STATUS_OK)
-    {
-      Serial.print(F("Internal failure in RFID reader: "));
-      Serial.print(rfid.GetStatusCodeName(ret)); Serial.print(" while reading block #"); Serial.println(blockAddr);
-      return;
-    }
-
-    Serial.print("Data in block #"); Serial.print(blockAddr); Serial.print(": ");
-    dump_byte_array(buffer, 16); Serial.println();
+  LightConfiguration config;
+  if (decodeTag(lightsDataBuffer[0], numBlocks, lights, NUM_LIGHTOBJECTS, config))
+    tagCache.store(rfid.uid, config);
 
-    for (byte i = 0; i < 5; ++i)
-    {
-      byte lightIdx = blockOffset * 5 + i;
-      if (lightIdx >= NUM_LIGHTOBJECTS) {
-        // Serial.print("Light #"); Serial.print(lightIdx); Serial.println(" not installed; terminating light deserialization for this block.");
-        break; // TODO: we should probably skip the next block too but whatever!
-      }
-      // Serial.print("Deserializing light #"); Serial.println(lightIdx);
-      lights[lightIdx]->deserialize( &(((LightDataBlock*) buffer)[i]) );
-    }
-  }
-
-  Serial.println("Programmed lights with tag data.");
+  logEvent(LOG_TAG_WRITTEN);
 };
 
 void applyDefaultSettings()
 {
-  for (byte block = 0; block < MW_RFID_DATA_BLOCK_COUNT; ++block)
-    {
-      for (byte i = 0; i < 5; ++i)
-      {
-        byte lightIdx = block * 5 + i;
-        if (lightIdx >= NUM_LIGHTOBJECTS)
-          break;
-        lights[lightIdx]->deserialize( &(((LightDataBlock*) defaultLightConfiguration[block])[i]) );
-      }
-    }
+  LightConfiguration config;
+  if (decodeTag(defaultLightConfiguration[0], MW_RFID_DATA_BLOCK_COUNT, lights, NUM_LIGHTOBJECTS, config))
+    applyLightConfiguration(config, lights, NUM_LIGHTOBJECTS);
 }
 
-void loop()
+/**
+ * A tag was identified: known tags apply right away, from the cache; reading them only confirms or corrects it.
+ */
+void applyCachedTag(const MFRC522::Uid& iUid)
 {
-  //debug_printFPS();
-
-  checkButtons();
+  LightConfiguration config;
+  if (tagCache.lookup(iUid, config) && applyLightConfiguration(config, lights, NUM_LIGHTOBJECTS))
+    logEvent(LOG_TAG_APPLIED_CACHED);
+}
 
-  for (byte i = 0; i < NUM_LIGHTOBJECTS; ++i)
+/**
+ * A tag was read: apply its data, then cache it; forget the tag if its data isn't valid anymore.
+ */
+void applyReadTag(const MFRC522::Uid& iUid, const byte* iBlocks, byte iNumBlocks)
+{
+  LightConfiguration config;
+  if (decodeTag(iBlocks, iNumBlocks, lights, NUM_LIGHTOBJECTS, config))
+  {
+    if (applyLightConfiguration(config, lights, NUM_LIGHTOBJECTS))
+      logEvent(LOG_TAG_APPLIED);
+    tagCache.store(iUid, config);
+  }
+  else
   {
-    lights[i]->update();
+    tagCache.remove(iUid);
   }
+}
 
-  FastLED.show();
+void checkRFID()
+{
+#ifdef MW_REPLAY
+  return; // replays script their tag reads, and must not depend on whatever is near the reader
+#endif
 
   if (rfidGlobalOverride) { // apply some default lights without querying RFID reader
     applyDefaultSettings();
@@ -174,29 +219,64 @@ void loop()
   }
   else // Get light info (or save it) from RFID
   {
-    static uint16_t prevRFIDCheck = millis();
-    uint16_t now = millis();
-    if ((uint16_t)(now - prevRFIDCheck) < 500) // don't check the RFID reader too often; even a simple PICC_IsNewCardPresent() is costly and drops FPS from ~50 to 30
+    switch (tagReader.update(!rfidWrite))
+    {
+    case TagReader::TAG_READER_IDENTIFIED:
+      applyCachedTag(rfid.uid);
+      break;
+    case TagReader::TAG_READER_READ:
+      applyReadTag(rfid.uid, tagReader.block(0), tagReader.blockCount());
+      break;
+    case TagReader::TAG_READER_SELECTED:
     {
-      return;
-    }
-
-    prevRFIDCheck = now;
-    if (rfid.PICC_IsNewCardPresent() && rfid.PICC_ReadCardSerial()) {
       ReaderSession reader(rfid); // used for automatic cleanup, regardless of errors
-
-      printTagDebug(rfid);
-      if (!checkCompatibleTag(rfid))
-        return;
-
-      if (rfidWrite)
-      {
-        writeLightSettingsToTag();
-      } else // read tag and apply settings
-      {
-        readLightSettingsFromTag();
-      }
+      writeLightSettingsToTag(reader);
+      tagReader.release();
+      break;
+    }
+    default:
+      break;
     }
   }
+};
+
+void runButtons()
+{
+  checkButtons();
+  PROFILE_MARK(PROFILE_STAGE_BUTTONS);
+};
+
+void renderFrame()
+{
+  PROFILE_FRAME_BEGIN();
+
+  UpdateLight updateLight;
+  Lights::forEach(updateLight);
+
+  // only clock out the strips that changed, instead of FastLED.show() pushing all ~620 pixels every frame
+  ShowLight showLight;
+  Lights::forEach(showLight);
+  if (showLight.shown)
+    FastLED.countFPS(); // keep debug_printFPS() meaningful, since we bypass FastLED.show()
 
+  PROFILE_FRAME_END();
+};
+
+void runRFID()
+{
+  checkRFID();
+  tagCache.update(); // EEPROM writes of the tag cache, a byte at a time
+  PROFILE_MARK(PROFILE_STAGE_RFID);
+};
+
+void runSerial()
+{
+  serialControl.update();
+  eventLog.drain();
+  PROFILE_MARK(PROFILE_STAGE_SERIAL);
+};
+
+void loop()
+{
+  scheduler.run();
 };
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <FastLED.h>
+
+#include "config.h"
+#include "quakeFlicker.h"
+#include "pacifica.h"
+#include "patternVM.h"
+#include "LED_functions.h"
+
+// ----------------------------------------------------------------
+// On-target microbenchmarks for the lighting engine.
+// Enable with MW_BENCHMARK in config.h; results are printed on Serial from setup(), before the lights start running.
+// Each benchmark renders BENCHMARK_FRAMES frames into a scratch buffer (nothing is pushed to the strips) and reports
+// the average cost per frame and per LED, so we have a baseline to compare every renderer change against.
+// The same benchmarks also build and run on a Linux host, see host/Makefile; those numbers only compare host builds.
+// ----------------------------------------------------------------
+#ifdef MW_BENCHMARK
+
+#ifndef BENCHMARK_FRAMES
+#define BENCHMARK_FRAMES 64
+#endif
+
+static CRGB benchmarkLEDs[NUM_LEDS_GROUNDLIGHTS];
+
+void printBenchmarkResult(const __FlashStringHelper* iName, byte iIndex, uint16_t iNumLEDs, uint32_t iElapsedMicros)
+{
+  uint32_t nsPerFrame = (iElapsedMicros * 1000) / BENCHMARK_FRAMES;
+
+  Serial.print(F("bench ")); Serial.print(iName); Serial.print(iIndex);
+  Serial.print(F(" leds=")); Serial.print(iNumLEDs);
+  Serial.print(F(": ")); Serial.print(nsPerFrame); Serial.print(F(" ns/frame, "));
+  Serial.print(nsPerFrame / iNumLEDs); Serial.println(F(" ns/LED"));
+}
+
+/**
+ * One frame of a Quake style pattern on iNumLEDs LEDs: a flicker step, the one CHSV to CRGB conversion of its solid color,
+ * then that color written to every LED. show() streams the color without a buffer, and crossfades fill one; either way
+ * every LED gets it, so the fill stands in for the per LED cost.
+ * ioPrev is rewound by half an animation step every frame, so the benchmark walks the whole style (including the lerped transitions)
+ * instead of sitting on the first step.
+ */
+uint32_t benchmarkLightstyle(byte iPatternID, uint16_t iNumLEDs)
+{
+  uint32_t prev = clockMillis();
+  byte prevPatternID = iPatternID;
+  byte patternStep = 0;
+
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    prev -= FTIME / 2;
+    byte val = enhancedQuakeFlicker(prev, iPatternID, prevPatternID, patternStep);
+    fill_solid(benchmarkLEDs, iNumLEDs, CHSV(160, 255, val));
+  }
+  return micros() - start;
+}
+
+uint32_t benchmarkPacifica(uint16_t iNumLEDs)
+{
+  Pacifica pacifica;
+
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    pacifica.advance();
+    pacifica.render(benchmarkLEDs, iNumLEDs);
+  }
+  return micros() - start;
+}
+
+/**
+ * One frame of a spatial Quake style, as PatternLightLEDStrip::update() renders it. Time moves by half an animation step
+ * every frame, like benchmarkLightstyle(), and wraps around at the end of the style, like advanceSpatialLightstyle().
+ */
+uint32_t benchmarkSpatialLightstyle(byte iSpatialID, uint16_t iNumLEDs)
+{
+  const uint16_t end = pgm_read_byte(&spatialLightstyles[iSpatialID].style.length) * FTIME;
+  uint16_t time = 0;
+
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    time = (time + FTIME / 2) % end;
+    renderSpatialLightstyle(iSpatialID, time, CHSV(160, 255, 255), benchmarkLEDs, iNumLEDs);
+  }
+  return micros() - start;
+}
+
+uint32_t benchmarkPacificaReference(uint16_t iNumLEDs)
+{
+  Pacifica pacifica;
+
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    pacifica.advance();
+    pacifica.renderReference(benchmarkLEDs, iNumLEDs);
+  }
+  return micros() - start;
+}
+
+/**
+ * Render BENCHMARK_FRAMES frames with both the fused Pacifica kernel and the original multi-pass renderer, side by side
+ * in the two halves of the scratch buffer, and return the largest difference seen on any channel of any LED. Should be 0.
+ */
+uint8_t comparePacificaToReference()
+{
+  static const uint16_t numLEDs = NUM_LEDS_GROUNDLIGHTS / 2;
+  Pacifica pacifica;
+  uint8_t maxDiff = 0;
+
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    pacifica.advance();
+    pacifica.render(benchmarkLEDs, numLEDs);
+    pacifica.renderReference(benchmarkLEDs + numLEDs, numLEDs);
+    for (uint16_t i = 0; i < numLEDs; ++i)
+      for (byte channel = 0; channel < 3; ++channel)
+      {
+        uint8_t a = benchmarkLEDs[i][channel], b = benchmarkLEDs[numLEDs + i][channel];
+        uint8_t diff = a > b ? a - b : b - a;
+        if (diff > maxDiff)
+          maxDiff = diff;
+      }
+    delay(7); // let the waves actually move between frames
+  }
+  return maxDiff;
+}
+
+uint32_t benchmarkPatternProgram(byte iIndex, uint16_t iNumLEDs)
+{
+  PatternVM vm;
+  vm.select(iIndex);
+
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    vm.run(benchmarkLEDs, iNumLEDs, 160, 255, 255);
+  }
+  return micros() - start;
+}
+
+uint32_t benchmarkSetAllLEDsHSV(uint16_t iNumLEDs)
+{
+  uint32_t start = micros();
+  for (uint16_t frame = 0; frame < BENCHMARK_FRAMES; ++frame)
+  {
+    setAllLEDs(CHSV(frame, 255, 255), benchmarkLEDs, iNumLEDs);
+  }
+  return micros() - start;
+}
+
+void runBenchmarks()
+{
+  static const uint16_t pacificaSizes[] = {NUM_LEDS_WINDOWS, NUM_LEDS_WATERFALL_CENTER, NUM_LEDS_GROUNDLIGHTS};
+
+  Serial.print(F("Running benchmarks, ")); Serial.print(BENCHMARK_FRAMES); Serial.println(F(" frames each..."));
+
+  for (byte i = 0; i < NUM_LIGHTSTYLES; ++i)
+    printBenchmarkResult(F("lightstyle #"), i, NUM_LEDS_GROUNDLIGHTS, benchmarkLightstyle(i, NUM_LEDS_GROUNDLIGHTS));
+
+  for (byte i = 0; i < NUM_SPATIAL_LIGHTSTYLES; ++i)
+    printBenchmarkResult(F("spatial lightstyle #"), i, NUM_LEDS_GROUNDLIGHTS, benchmarkSpatialLightstyle(i, NUM_LEDS_GROUNDLIGHTS));
+
+  for (byte i = 0; i < sizeof(pacificaSizes) / sizeof(pacificaSizes[0]); ++i)
+    printBenchmarkResult(F("pacifica #"), i, pacificaSizes[i], benchmarkPacifica(pacificaSizes[i]));
+  for (byte i = 0; i < sizeof(pacificaSizes) / sizeof(pacificaSizes[0]); ++i)
+    printBenchmarkResult(F("pacifica (reference) #"), i, pacificaSizes[i], benchmarkPacificaReference(pacificaSizes[i]));
+  Serial.print(F("pacifica max channel diff vs reference: ")); Serial.println(comparePacificaToReference());
+
+  for (byte i = 0; i < NUM_BUILTIN_PATTERN_PROGRAMS; ++i)
+    printBenchmarkResult(F("pattern program #"), i, NUM_LEDS_GROUNDLIGHTS, benchmarkPatternProgram(i, NUM_LEDS_GROUNDLIGHTS));
+
+  printBenchmarkResult(F("setAllLEDs(CHSV) #"), 0, NUM_LEDS_GROUNDLIGHTS, benchmarkSetAllLEDsHSV(NUM_LEDS_GROUNDLIGHTS));
+
+  Serial.println(F("Benchmarks done."));
+}
+
+#endif // MW_BENCHMARK
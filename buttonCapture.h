@@ -0,0 +1,186 @@
+#pragma once
+
+#include <AceButton.h>
+using namespace ace_button;
+
+#include "config.h"
+#include "log.h"
+
+// ----------------------------------------------------------------
+// Interrupt driven button capture.
+// Instead of reading the buttons whenever the main loop gets around to it (which, in the middle of FastLED.show() or an
+// RFID read, can be long enough to delay or miss presses), every change of level is timestamped by an ISR as it happens,
+// and queued. The main loop drains the queue, replaying each change into AceButton at the time it was captured, so
+// debouncing and click/double-click/long press detection see the real timing, however late the queue is drained.
+//
+// Buttons on pins of the PCINT0 group (port B) are captured by its pin change ISR. On the Mega, that's only some of them:
+// e.g. pins 10 and 11 (PB4, PB5) are, but pins 8 and 9 (PH5, PH6) have no pin change interrupt at all; those, and any on
+// another PCINT group, are sampled at 1kHz instead, from a Timer0 compare match interrupt (Timer0 keeps running millis(),
+// its compare match A is free). Only defining the vectors actually used leaves the other PCINT groups to libraries.
+// Both ISRs snapshot all the buttons at once, and AVR ISRs don't nest, so the queue only ever has a single producer.
+//
+// Buttons must use a QueuedButtonConfig each, since that's where the replayed level and time are read from.
+// ----------------------------------------------------------------
+#define BUTTON_CAPTURE_MAX_BUTTONS 8 // levels are a bit each, in a byte
+
+static_assert((MW_BUTTON_QUEUE_SIZE & (MW_BUTTON_QUEUE_SIZE - 1)) == 0 && MW_BUTTON_QUEUE_SIZE <= 128, "MW_BUTTON_QUEUE_SIZE must be a power of 2, up to 128");
+
+/**
+ * Feeds AceButton the level and time of queued changes, rather than the live pin and clock.
+ */
+class QueuedButtonConfig : public ButtonConfig
+{
+  uint8_t _level = HIGH;
+  uint16_t _clock = 0;
+
+public:
+  void set(uint8_t iLevel, uint16_t iClock)
+  {
+    _level = iLevel;
+    _clock = iClock;
+  }
+
+  unsigned long getClock() override { return _clock; }
+  int readButton(uint8_t iPin) override { return _level; }
+};
+
+struct ButtonEdge
+{
+  uint16_t time; // millis() when captured
+  byte levels;   // of every button then, bit N for button N
+};
+
+class ButtonCapture
+{
+  AceButton* const* _buttons = nullptr;
+  byte _numButtons = 0;
+  volatile uint8_t* _inputs[BUTTON_CAPTURE_MAX_BUTTONS];
+  uint8_t _masks[BUTTON_CAPTURE_MAX_BUTTONS];
+
+  ButtonEdge _queue[MW_BUTTON_QUEUE_SIZE];
+  volatile byte _head = 0; // only written by capture()
+  volatile byte _tail = 0; // only written by drain()
+  volatile byte _levels = 0xFF; // as last captured
+  volatile bool _overflow = false;
+
+  byte _drainedLevels = 0xFF; // as last replayed
+  uint16_t _clock = 0;        // last time replayed
+
+  byte readLevels()
+  {
+    byte levels = 0;
+    for (byte i = 0; i < _numButtons; ++i)
+      if (*_inputs[i] & _masks[i])
+        levels |= 1 << i;
+    return levels;
+  }
+
+  /**
+   * Run every button's state machine at iTime, with iLevels. Time never goes backwards: a change captured while the queue
+   * was drained may be older than the last idle check.
+   */
+  void replay(byte iLevels, uint16_t iTime)
+  {
+    if ((int16_t)(iTime - _clock) > 0)
+      _clock = iTime;
+    for (byte i = 0; i < _numButtons; ++i)
+    {
+      static_cast<QueuedButtonConfig*>(_buttons[i]->getButtonConfig())->set((iLevels >> i) & 1, _clock);
+      _buttons[i]->check();
+    }
+    _drainedLevels = iLevels;
+  }
+
+  void replayQueued()
+  {
+    while (_tail != _head)
+    {
+      ButtonEdge edge = _queue[_tail];
+      asm volatile("" ::: "memory"); // the edge must be read before its slot is released
+      _tail = (_tail + 1) & (MW_BUTTON_QUEUE_SIZE - 1);
+      replay(edge.levels, edge.time);
+    }
+  }
+
+public:
+  /**
+   * Start capturing iButtons, iNumButtons initialized AceButtons with a QueuedButtonConfig each; their pins must already be inputs.
+   */
+  void setup(AceButton* const* iButtons, byte iNumButtons)
+  {
+    _buttons = iButtons;
+    _numButtons = min(iNumButtons, BUTTON_CAPTURE_MAX_BUTTONS);
+
+    bool sampled = false;
+    for (byte i = 0; i < _numButtons; ++i)
+    {
+      uint8_t pin = _buttons[i]->getPin();
+      _inputs[i] = portInputRegister(digitalPinToPort(pin));
+      _masks[i] = digitalPinToBitMask(pin);
+
+      if (digitalPinToPCICR(pin) && digitalPinToPCICRbit(pin) == PCIE0)
+      {
+        *digitalPinToPCICR(pin) |= _BV(digitalPinToPCICRbit(pin));
+        *digitalPinToPCMSK(pin) |= _BV(digitalPinToPCMSKbit(pin));
+      }
+      else
+        sampled = true;
+    }
+    _levels = _drainedLevels = readLevels();
+
+    if (sampled)
+    {
+      OCR0A = 0x80; // anywhere in Timer0's 1.024ms cycle, away from its overflow (millis())
+      TIMSK0 |= _BV(OCIE0A);
+    }
+  }
+
+  /**
+   * Queue the buttons' levels if any changed. Called from the ISRs only.
+   */
+  void capture()
+  {
+    byte levels = readLevels();
+    if (levels == _levels)
+      return;
+
+    byte next = (_head + 1) & (MW_BUTTON_QUEUE_SIZE - 1);
+    if (next == _tail)
+    {
+      _overflow = true; // drop the change; drain() catches up
+      return;
+    }
+    _queue[_head].time = millis();
+    _queue[_head].levels = levels;
+    asm volatile("" ::: "memory"); // the edge must be written before it's published
+    _head = next;
+    _levels = levels;
+  }
+
+  /**
+   * Replay queued changes, then check the buttons as of now, for time based events (click and long press delays).
+   * Run from the main loop; logs LOG_BUTTONS_DROPPED if the queue filled up since the last run.
+   */
+  void drain()
+  {
+    replayQueued();
+    if (_overflow)
+    {
+      _overflow = false;
+      logEvent(LOG_BUTTONS_DROPPED);
+
+      // the dropped change may have been the last one for a while, so don't wait for the next to catch up
+      noInterrupts();
+      capture();
+      interrupts();
+      replayQueued();
+    }
+    replay(_drainedLevels, millis());
+  }
+};
+
+ButtonCapture buttonCapture;
+
+// only the PCINT0 group (port B) has buttons, see MW3_PIN_LAYOUT.h
+ISR(PCINT0_vect) { buttonCapture.capture(); }
+ISR(TIMER0_COMPA_vect) { buttonCapture.capture(); }
@@ -4,27 +4,31 @@
 using namespace ace_button;
 
 #include "MW3_PIN_LAYOUT.h"
+#include "buttonCapture.h"
 #include "lights.h"
 
-ButtonConfig adminButtonConfig;
+QueuedButtonConfig adminButtonConfig;
 AceButton adminButton(&adminButtonConfig);
 
-ButtonConfig modeButtonConfig;
+QueuedButtonConfig modeButtonConfig;
 AceButton modeButton(&modeButtonConfig);
 
-ButtonConfig colorButtonConfig;
+QueuedButtonConfig colorButtonConfig;
 AceButton colorButton(&colorButtonConfig);
 
-ButtonConfig rfidButtonConfig;
+QueuedButtonConfig rfidButtonConfig;
 AceButton rfidButton(&rfidButtonConfig);
 
+AceButton* const buttons[] = {&adminButton, &modeButton, &colorButton, &rfidButton};
+
 // yes, this is fucking gross
-extern ILight *lights[];
+extern ILight** const lights;
 extern byte whichObject;
 extern const byte NUM_LIGHTOBJECTS;
 
 // some more globals to clean up, in theory...
 bool rfidWrite = false;
+bool rfidWriteOnce = false; // armed over serial rather than by holding the button: disarm once a tag has been written
 bool rfidGlobalOverride = false;
 
 void adminButtonEventHandler(AceButton *button, uint8_t eventType, uint8_t buttonState)
@@ -76,9 +80,11 @@ void rfidButtonEventHandler(AceButton* button, uint8_t eventType, uint8_t button
   {
     case AceButton::kEventPressed:
       rfidWrite = true;
+      rfidWriteOnce = false;
       break;
     case AceButton::kEventReleased:
       rfidWrite = false;
+      rfidWriteOnce = false;
       break;
     case AceButton::kEventDoubleClicked:
       rfidGlobalOverride = true;
@@ -110,19 +116,15 @@ void setupButtons()
 
   rfidButtonConfig.setFeature(ButtonConfig::kFeatureDoubleClick);
   rfidButtonConfig.setEventHandler(rfidButtonEventHandler);
+
+  buttonCapture.setup(buttons, sizeof(buttons) / sizeof(buttons[0]));
 }
 
+/**
+ * Run on every scheduler pass. Button changes are captured by interrupts (see buttonCapture.h), so this only has to
+ * process what was queued since the last pass; how long a pass takes doesn't change what events the buttons produce.
+ */
 void checkButtons()
 {
-  static uint16_t prev = millis();
-
-  uint16_t now = millis();
-  if ((uint16_t)(now - prev) >= 5)
-  {
-    adminButton.check();
-    modeButton.check();
-    colorButton.check();
-    rfidButton.check();
-    prev = now;
-  }
-}
\ No newline at end of file
+  buttonCapture.drain();
+}
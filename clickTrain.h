@@ -0,0 +1,102 @@
+#pragma once
+
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+// ----------------------------------------------------------------
+// Background generator of "button clicks" on an output pin, for the fairy lights' own controller.
+// Timer5 runs in CTC mode with a compare interrupt every CLICK_TRAIN_HALF_PERIOD ms; each click is one period low
+// (pressed), then one period high (released). Clicks are only counted, never queued individually: whoever drives the
+// train can replace the count of clicks not started yet at any time, so a new target supersedes stale clicks.
+// The interrupt is only enabled while there are clicks to send.
+// Timer5 only drives PWM on pins 44 to 46, which we only use as bit banged LED data pins.
+// ----------------------------------------------------------------
+#define CLICK_TRAIN_HALF_PERIOD 40 // ms
+
+class ClickTrain
+{
+  volatile uint8_t* _port = nullptr;
+  uint8_t _bitMask = 0;
+
+  volatile byte _queued = 0;     // clicks not started yet
+  volatile bool _pressed = false; // a click is in progress, and the pin is low
+
+  void start()
+  {
+    // first click starts right away, the interrupt takes it from there
+    *_port &= ~_bitMask;
+    _pressed = true;
+    --_queued;
+    TCNT5 = 0;
+    TIFR5 = _BV(OCF5A);
+    TIMSK5 = _BV(OCIE5A);
+  }
+
+public:
+  void setup(int iPin)
+  {
+    pinMode(iPin, OUTPUT);
+    digitalWrite(iPin, HIGH);
+    _port = portOutputRegister(digitalPinToPort(iPin));
+    _bitMask = digitalPinToBitMask(iPin);
+
+    TIMSK5 = 0;
+    TCCR5A = 0;
+    TCCR5B = _BV(WGM52) | _BV(CS52) | _BV(CS50); // CTC on OCR5A, clk/1024
+    OCR5A = (F_CPU / 1024UL) * CLICK_TRAIN_HALF_PERIOD / 1000 - 1;
+  }
+
+  /**
+   * Clicks queued but not started yet. A click in progress is considered done, i.e. already counted by whoever receives them.
+   */
+  byte queued()
+  {
+    return _queued;
+  }
+
+  /**
+   * Replace the clicks not started yet with iClicks clicks. Callers reading queued() to work out iClicks should do both
+   * in the same ATOMIC_BLOCK, so that no click starts in between.
+   */
+  void setQueued(byte iClicks)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      _queued = iClicks;
+      if (_queued && !_pressed && !(TIMSK5 & _BV(OCIE5A)))
+        start();
+    }
+  }
+
+  bool busy()
+  {
+    return _queued || _pressed;
+  }
+
+  // Timer5 compare interrupt only; not for use elsewhere
+  void tick()
+  {
+    if (_pressed)
+    {
+      *_port |= _bitMask; // release
+      _pressed = false;
+    }
+    else if (_queued)
+    {
+      *_port &= ~_bitMask; // press
+      _pressed = true;
+      --_queued;
+    }
+    else
+    {
+      TIMSK5 = 0; // idle until the next setQueued()
+    }
+  }
+};
+
+ClickTrain fairyClickTrain;
+
+ISR(TIMER5_COMPA_vect)
+{
+  fairyClickTrain.tick();
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Time source for all light animations.
+// A single 32-bit frame clock: tickClock() reads the time once per scheduler pass (see scheduler.h), and everything that
+// runs in that pass sees the same clockMillis() and clockMicros(), so tasks never disagree about what time it is, and
+// never have to truncate timestamps to compare them.
+// Normally the time comes from millis(); replay builds (MW_REPLAY) swap in a virtual clock that only moves when the
+// replay script says so, which makes every frame reproducible. FastLED's beat/wave functions read the frame clock too,
+// through get_millisecond_timer(), see USE_GET_MILLISECOND_TIMER in MW3.ino, so they agree with everything else in a pass.
+// ----------------------------------------------------------------
+uint32_t frameMillis = 0;
+uint32_t frameMicros = 0;
+
+inline uint32_t clockMillis() { return frameMillis; }
+inline uint32_t clockMicros() { return frameMicros; }
+
+uint32_t get_millisecond_timer() { return clockMillis(); }
+
+#ifdef MW_REPLAY
+
+uint32_t virtualMillis = 0;
+
+void advanceClock(uint16_t iMillis) { virtualMillis += iMillis; }
+
+inline void tickClock()
+{
+  frameMillis = virtualMillis;
+  frameMicros = virtualMillis * 1000;
+}
+
+#else
+
+inline void tickClock()
+{
+  frameMillis = millis();
+  frameMicros = micros();
+}
+
+#endif // MW_REPLAY
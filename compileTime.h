@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------
+// Small compile time helpers, used to expand tables into PROGMEM at build time (avr-libc has no <utility>)
+// ----------------------------------------------------------------
+
+// IndexSequence<0, 1, ..., N-1>, as MakeIndexSequence<N>::type
+template <uint8_t... Is> struct IndexSequence {};
+template <uint8_t N, uint8_t... Is> struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Is...> {};
+template <uint8_t... Is> struct MakeIndexSequence<0, Is...> { typedef IndexSequence<Is...> type; };
@@ -3,12 +3,52 @@
 // RFID settings
 #define MW_RFID_DATA_BLOCK_ADDR 4
 #define MW_RFID_DATA_BLOCK_COUNT 3 // this caps the number of connected lights to 15... but we only have 12 distinct ports anyway
+#define MW_RFID_POLL_INTERVAL 50 // ms between tag detection attempts; detection and reads are spread over frames by TagReader, so this can be short
+#define MW_RFID_TIME_SLICE_US 1000 // max time spent driving the RFID reader in a single loop() iteration
+#define MW_TAG_CACHE_ENTRIES 16 // number of tags remembered in EEPROM, see tagCache.h
+#define MW_TAG_CACHE_EEPROM_ADDR 0
+
+// Pattern program settings, see patternVM.h
+#define MW_PATTERN_CYCLE_BUDGET 64000UL // estimated CPU cycles a pattern program may spend on a single frame, i.e. 4ms
+#define MW_PATTERN_EEPROM_SLOTS 4 // user programs, uploaded through the serial control protocol
+#define MW_PATTERN_PROGRAM_SIZE 48 // max bytes per uploaded program
+#define MW_PATTERN_EEPROM_ADDR 1024 // right after the tag cache
+
+// Scheduler settings, see scheduler.h
+#define MW_FRAME_INTERVAL 16 // ms between rendered frames, i.e. ~60 FPS
+#define MW_TASK_DEADLINE 50 // ms a task may start late before it's logged; background tasks run at least this often
+
+// Button settings, see buttonCapture.h
+#define MW_BUTTON_QUEUE_SIZE 16 // button changes captured between two scheduler passes; power of 2, up to 128
+
+// Serial control settings, see serialControl.h
+#define MW_SERIAL_CONTROL_MAX_FRAME 64 // decoded bytes; enough for a SERIAL_CMD_SET_ALL or a SERIAL_CMD_QUERY reply with 15 lights
+#define MW_SERIAL_CONTROL_BYTES_PER_UPDATE 64 // max bytes read from Serial per loop() iteration, i.e. the whole RX buffer
+
+// Log settings, see log.h
+#define MW_LOG_BUFFER_SIZE 128 // bytes of RAM for pending log events; power of 2, up to 128
+#define MW_LOG_DRAIN_BYTES_PER_FRAME 32 // max bytes of log frames sent per loop() iteration
 
 // LED settings
 #define NUM_LEDS_WINDOWS 16
-// NB: only 212 working right now for some reason?
-#define NUM_LEDS_GROUNDLIGHTS 230 // NOTE: one side is actually only 142, and the other is identical + the back strip; it should be okay to drive both at the longer length
-#define NUM_LEDS_WATERFALL_SIDES 20
+#define NUM_LEDS_GROUNDLIGHTS_SIDE 142 // one side on its own strip; the other side is identical, and followed by the back on the same strip
+#define NUM_LEDS_GROUNDLIGHTS_BACK 70 // the back was assumed to be 88 (230 on the strip), but only 212 pixels respond; driving the 18 that don't only cost show time
+#define NUM_LEDS_GROUNDLIGHTS (NUM_LEDS_GROUNDLIGHTS_SIDE + NUM_LEDS_GROUNDLIGHTS_BACK) // unique pixels, and longest strip
+#define NUM_LEDS_WATERFALL_SIDES 20 // both sides are identical, and mirror the top of the center
 #define NUM_LEDS_WATERFALL_CENTER 85
 #define NUM_LEDS_ADMIN_RING 7
 #define BRIGHTNESS 255
+#define MW_LED_ARENA_BUDGET 1536 // max bytes of SRAM for the LED buffers of all lights, checked at compile time; see stripLayout.h
+#define MW_OVERLAY_STACK_DEPTH 2 // max number of timed overlays (e.g. pulse()) running at once on a single light, see overlay.h
+#define MW_TRANSITION_UNIT 20 // ms per unit of transition durations, which are stored as a byte, see transition.h
+#define MW_TRANSITION_DEFAULT 25 // crossfade duration when changing patterns with the buttons, or applying a tag that doesn't have one; 0 to cut instead
+#define MW_TRANSITION_SNAPSHOT_PIXELS 32 // max pixels of the outgoing frame kept by a light during a crossfade, i.e. 3 bytes of SRAM each
+
+// Debug settings
+// #define MW_BENCHMARK // run the lighting engine benchmarks from setup() and print ns/frame and ns/LED for every pattern on Serial
+// #define MW_CYCLE_PROFILE // profile each task (buttons, each light's update and show, the whole frame, RFID, serial) with Timer1, see profiler.h
+#define MW_PROFILE_REPORT_INTERVAL 2000 // ms between profile dumps on Serial; 0 to only dump on demand
+// #define MW_SIMULATION // with MW_CYCLE_PROFILE: run for MW_SIMULATION_MILLIS, dump the profile, and halt; for simulator runs, see sim/Makefile
+#define MW_SIMULATION_MILLIS 2000
+// #define MW_LOG_TEXT // print log events as text on target, instead of binary frames for tools/decode_log.py
+// #define MW_REPLAY // replace normal operation with the scripted replay in replay.h, running on a virtual clock and printing per-frame output checksums on Serial
@@ -0,0 +1,14 @@
+// The benchmarks of benchmark.h, on the host, see Makefile
+
+#include <Arduino.h>
+
+#include "config.h"
+#include "clock.h"
+#include "lights.h"
+#include "benchmark.h"
+
+int main()
+{
+  runBenchmarks();
+  return 0;
+}
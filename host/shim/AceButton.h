@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ----------------------------------------------------------------
+// The part of AceButton the sketch uses. check() only reports kEventPressed and kEventReleased, without debouncing; host
+// pins never change anyway (see Arduino.cpp), and replay.h calls the event handlers directly.
+// ----------------------------------------------------------------
+namespace ace_button
+{
+
+class AceButton;
+
+class ButtonConfig
+{
+public:
+  typedef void (*EventHandler)(AceButton* iButton, uint8_t iEventType, uint8_t iButtonState);
+
+  static const uint16_t kFeatureClick = 0x01;
+  static const uint16_t kFeatureDoubleClick = 0x02;
+  static const uint16_t kFeatureLongPress = 0x04;
+
+  EventHandler eventHandler = nullptr;
+
+  virtual ~ButtonConfig() {}
+  virtual unsigned long getClock() { return millis(); }
+  virtual int readButton(uint8_t iPin) { return digitalRead(iPin); }
+
+  void setFeature(uint16_t iFeature) {}
+  void setEventHandler(EventHandler iHandler) { eventHandler = iHandler; }
+  void setClickDelay(uint16_t iDelay) {}
+  void setLongPressDelay(uint16_t iDelay) {}
+  uint16_t getDebounceDelay() { return 20; }
+};
+
+class AceButton
+{
+  ButtonConfig* _config;
+  uint8_t _pin = 0;
+  uint8_t _releasedState = HIGH;
+  uint8_t _lastState = HIGH;
+
+public:
+  static const uint8_t kEventPressed = 0;
+  static const uint8_t kEventReleased = 1;
+  static const uint8_t kEventClicked = 2;
+  static const uint8_t kEventDoubleClicked = 3;
+  static const uint8_t kEventLongPressed = 4;
+
+  AceButton(ButtonConfig* iConfig) : _config(iConfig) {}
+
+  void init(uint8_t iPin, uint8_t iReleasedState = HIGH, uint8_t iID = 0)
+  {
+    _pin = iPin;
+    _releasedState = _lastState = iReleasedState;
+  }
+
+  void check()
+  {
+    uint8_t state = _config->readButton(_pin);
+    if (state == _lastState)
+      return;
+    _lastState = state;
+    if (_config->eventHandler)
+      _config->eventHandler(this, state == _releasedState ? kEventReleased : kEventPressed, state);
+  }
+
+  uint8_t getPin() { return _pin; }
+  ButtonConfig* getButtonConfig() { return _config; }
+};
+
+} // namespace ace_button
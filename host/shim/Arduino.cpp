@@ -0,0 +1,89 @@
+#include "Arduino.h"
+
+#include <stdio.h>
+#include <time.h>
+
+volatile uint8_t SREG;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+volatile uint16_t TCNT1, OCR1A;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+volatile uint16_t TCNT5, OCR5A;
+volatile uint8_t TIMSK0, OCR0A;
+volatile uint8_t PCICR, PCMSK0, PCIFR;
+
+HardwareSerial Serial;
+
+// ----------------------------------------------------------------
+// Time, from the first call on
+// ----------------------------------------------------------------
+static uint64_t monotonicMicros()
+{
+  static uint64_t start = 0;
+  timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  uint64_t t = (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+  if (!start)
+    start = t;
+  return t - start;
+}
+
+unsigned long millis() { return (uint32_t)(monotonicMicros() / 1000); }
+unsigned long micros() { return (uint32_t)monotonicMicros(); }
+
+void delay(unsigned long iMillis) { delayMicroseconds(iMillis * 1000); }
+
+void delayMicroseconds(unsigned int iMicros)
+{
+  timespec wait = {(time_t)(iMicros / 1000000), (long)(iMicros % 1000000) * 1000};
+  nanosleep(&wait, nullptr);
+}
+
+// ----------------------------------------------------------------
+// Pins: every input reads HIGH (buttons are pulled up, so released), outputs go nowhere
+// ----------------------------------------------------------------
+static volatile uint8_t portInput = 0xFF;
+static volatile uint8_t portOutput = 0;
+
+void pinMode(uint8_t iPin, uint8_t iMode) {}
+void digitalWrite(uint8_t iPin, uint8_t iLevel) {}
+int digitalRead(uint8_t iPin) { return HIGH; }
+void analogWrite(uint8_t iPin, int iValue) {}
+
+long map(long iValue, long iFromLow, long iFromHigh, long iToLow, long iToHigh)
+{
+  return (iValue - iFromLow) * (iToHigh - iToLow) / (iFromHigh - iFromLow) + iToLow;
+}
+
+uint8_t digitalPinToPort(uint8_t iPin) { return 0; }
+uint8_t digitalPinToBitMask(uint8_t iPin) { return 1 << (iPin & 7); }
+volatile uint8_t* portOutputRegister(uint8_t iPort) { return &portOutput; }
+volatile uint8_t* portInputRegister(uint8_t iPort) { return &portInput; }
+
+// ----------------------------------------------------------------
+// Print
+// ----------------------------------------------------------------
+size_t Print::write(uint8_t iByte) { return fwrite(&iByte, 1, 1, stdout); }
+size_t Print::write(const uint8_t* iBuffer, size_t iSize) { return fwrite(iBuffer, 1, iSize, stdout); }
+
+size_t Print::print(const char* iString) { return fputs(iString, stdout) < 0 ? 0 : strlen(iString); }
+size_t Print::print(const __FlashStringHelper* iString) { return print((const char*)iString); }
+size_t Print::print(char iChar) { return write((uint8_t)iChar); }
+size_t Print::print(unsigned char iValue, int iBase) { return print((unsigned long)iValue, iBase); }
+size_t Print::print(int iValue, int iBase) { return print((long)iValue, iBase); }
+size_t Print::print(unsigned int iValue, int iBase) { return print((unsigned long)iValue, iBase); }
+
+size_t Print::print(long iValue, int iBase)
+{
+  if (iBase == DEC)
+    return printf("%ld", iValue);
+  return print((unsigned long)(uint32_t)iValue, iBase); // like the AVR core, where long is 32 bit
+}
+
+size_t Print::print(unsigned long iValue, int iBase)
+{
+  return printf(iBase == HEX ? "%lX" : "%lu", iValue);
+}
+
+size_t Print::println() { return print("\r\n"); }
+
+void HardwareSerial::flush() { fflush(stdout); }
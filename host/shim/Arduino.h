@@ -0,0 +1,169 @@
+#pragma once
+
+// ----------------------------------------------------------------
+// Just enough of the Arduino core to build the sketch on a Linux host (see host/Makefile).
+// Flash and SRAM are the same memory here, so PROGMEM and pgm_read_*() are plain reads. The clock is the host's own
+// monotonic clock; AVR registers are plain variables nothing looks at, and ISRs are never called.
+// ----------------------------------------------------------------
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define DEC 10
+#define HEX 16
+
+#define A0 54
+#define E2END 0xFFF
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) ((const __FlashStringHelper*)(s))
+class __FlashStringHelper;
+typedef const char* PGM_P;
+#define pgm_read_byte(p) (*(const uint8_t*)(p))
+#define pgm_read_word(p) (*(const uint16_t*)(p))
+#define pgm_read_dword(p) (*(const uint32_t*)(p))
+#define pgm_read_ptr(p) (*(void* const*)(p))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define _BV(b) (1 << (b))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long iMillis);
+void delayMicroseconds(unsigned int iMicros);
+
+void pinMode(uint8_t iPin, uint8_t iMode);
+void digitalWrite(uint8_t iPin, uint8_t iLevel);
+int digitalRead(uint8_t iPin);
+void analogWrite(uint8_t iPin, int iValue);
+long map(long iValue, long iFromLow, long iFromHigh, long iToLow, long iToHigh);
+
+// no pin has a pin change interrupt, so buttonCapture.h samples them all from its timer ISR
+uint8_t digitalPinToPort(uint8_t iPin);
+uint8_t digitalPinToBitMask(uint8_t iPin);
+volatile uint8_t* portOutputRegister(uint8_t iPort);
+volatile uint8_t* portInputRegister(uint8_t iPort);
+#define digitalPinToPCICR(p) ((volatile uint8_t*)0)
+#define digitalPinToPCICRbit(p) 0
+#define digitalPinToPCMSK(p) ((volatile uint8_t*)0)
+#define digitalPinToPCMSKbit(p) 0
+
+#define noInterrupts()
+#define interrupts()
+#define cli()
+#define sei()
+#define ISR(vector) extern "C" void vector(void)
+
+extern volatile uint8_t SREG;
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1, TIFR1;
+extern volatile uint16_t TCNT1, OCR1A;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5, TIFR5;
+extern volatile uint16_t TCNT5, OCR5A;
+extern volatile uint8_t TIMSK0, OCR0A;
+extern volatile uint8_t PCICR, PCMSK0, PCIFR;
+
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define TOV1 0
+#define TOIE1 0
+#define CS50 0
+#define CS51 1
+#define CS52 2
+#define WGM52 3
+#define OCIE5A 1
+#define OCF5A 1
+#define OCIE0A 1
+#define PCIE0 0
+#define PCIF0 0
+
+#define PCINT0_vect __vector_9
+#define TIMER0_COMPA_vect __vector_21
+#define TIMER5_COMPA_vect __vector_47
+
+#define SERIAL_TX_BUFFER_SIZE 64
+
+/**
+ * A read-only string, for the sketch's string tables.
+ */
+class String
+{
+public:
+  String(const char* iString = "") : _string(iString) {}
+  char operator[](unsigned int iIndex) const { return _string[iIndex]; }
+  unsigned int length() const { return strlen(_string); }
+  const char* c_str() const { return _string; }
+
+private:
+  const char* _string;
+};
+
+/**
+ * Prints to stdout.
+ */
+class Print
+{
+public:
+  size_t write(uint8_t iByte);
+  size_t write(const uint8_t* iBuffer, size_t iSize);
+
+  size_t print(const char* iString);
+  size_t print(const __FlashStringHelper* iString);
+  size_t print(char iChar);
+  size_t print(unsigned char iValue, int iBase = DEC);
+  size_t print(int iValue, int iBase = DEC);
+  size_t print(unsigned int iValue, int iBase = DEC);
+  size_t print(long iValue, int iBase = DEC);
+  size_t print(unsigned long iValue, int iBase = DEC);
+
+  size_t println();
+  template <typename T>
+  size_t println(T iValue)
+  {
+    size_t n = print(iValue);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(T iValue, int iBase)
+  {
+    size_t n = print(iValue, iBase);
+    return n + println();
+  }
+};
+
+/**
+ * Serial is stdout; nothing is ever received.
+ */
+class HardwareSerial : public Print
+{
+public:
+  void begin(unsigned long iBaud) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  int availableForWrite() { return SERIAL_TX_BUFFER_SIZE - 1; }
+  void flush();
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+void setup();
+void loop();
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+
+/**
+ * E2END + 1 bytes of EEPROM, in memory: every run starts from an erased (0xFF) EEPROM.
+ */
+struct EEPROMClass
+{
+  uint8_t bytes[E2END + 1];
+
+  EEPROMClass() { memset(bytes, 0xFF, sizeof(bytes)); }
+
+  uint8_t read(int iAddress) { return bytes[iAddress]; }
+  void write(int iAddress, uint8_t iValue) { bytes[iAddress] = iValue; }
+  void update(int iAddress, uint8_t iValue) { bytes[iAddress] = iValue; }
+  uint16_t length() { return E2END + 1; }
+
+  template <typename T>
+  T& get(int iAddress, T& oValue)
+  {
+    memcpy(&oValue, bytes + iAddress, sizeof(T));
+    return oValue;
+  }
+
+  template <typename T>
+  const T& put(int iAddress, const T& iValue)
+  {
+    memcpy(bytes + iAddress, &iValue, sizeof(T));
+    return iValue;
+  }
+};
+
+extern EEPROMClass EEPROM;
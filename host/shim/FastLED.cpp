@@ -0,0 +1,345 @@
+#include "FastLED.h"
+
+CFastLED FastLED;
+
+uint16_t rand16seed = 1337; // RAND16_SEED
+
+// ----------------------------------------------------------------
+// Colors
+// ----------------------------------------------------------------
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb)
+{
+  // FastLED's default tuning: moderate yellow boost (Y1), green left as is
+  const uint8_t K255 = 255, K171 = 171, K170 = 170, K85 = 85;
+
+  uint8_t hue = hsv.hue;
+  uint8_t sat = hsv.sat;
+  uint8_t val = hsv.val;
+
+  uint8_t offset = hue & 0x1F; // 0..31
+  uint8_t offset8 = offset << 3;
+
+  uint8_t third = scale8(offset8, (256 / 3)); // max = 85
+
+  uint8_t r, g, b;
+
+  if (!(hue & 0x80))
+  {
+    if (!(hue & 0x40))
+    {
+      if (!(hue & 0x20))
+      {
+        // R -> O
+        r = K255 - third;
+        g = third;
+        b = 0;
+      }
+      else
+      {
+        // O -> Y
+        r = K171;
+        g = K85 + third;
+        b = 0;
+      }
+    }
+    else
+    {
+      if (!(hue & 0x20))
+      {
+        // Y -> G
+        uint8_t twothirds = scale8(offset8, ((256 * 2) / 3)); // max = 170
+        r = K171 - twothirds;
+        g = K170 + third;
+        b = 0;
+      }
+      else
+      {
+        // G -> A
+        r = 0;
+        g = K255 - third;
+        b = third;
+      }
+    }
+  }
+  else
+  {
+    if (!(hue & 0x40))
+    {
+      if (!(hue & 0x20))
+      {
+        // A -> B
+        uint8_t twothirds = scale8(offset8, ((256 * 2) / 3)); // max = 170
+        r = 0;
+        g = K171 - twothirds;
+        b = K85 + twothirds;
+      }
+      else
+      {
+        // B -> P
+        r = third;
+        g = 0;
+        b = K255 - third;
+      }
+    }
+    else
+    {
+      if (!(hue & 0x20))
+      {
+        // P -> K
+        r = K85 + third;
+        g = 0;
+        b = K171 - third;
+      }
+      else
+      {
+        // K -> R
+        r = K170 + third;
+        g = 0;
+        b = K85 - third;
+      }
+    }
+  }
+
+  // desaturate, and add the brightness floor
+  if (sat != 255)
+  {
+    if (sat == 0)
+    {
+      r = 255;
+      b = 255;
+      g = 255;
+    }
+    else
+    {
+      uint8_t desat = 255 - sat;
+      desat = scale8_video(desat, desat);
+
+      uint8_t satscale = 255 - desat;
+      r = scale8(r, satscale);
+      g = scale8(g, satscale);
+      b = scale8(b, satscale);
+
+      uint8_t brightness_floor = desat;
+      r += brightness_floor;
+      g += brightness_floor;
+      b += brightness_floor;
+    }
+  }
+
+  // scale down to the value
+  if (val != 255)
+  {
+    val = scale8_video(val, val);
+    if (val == 0)
+    {
+      r = 0;
+      g = 0;
+      b = 0;
+    }
+    else
+    {
+      r = scale8(r, val);
+      g = scale8(g, val);
+      b = scale8(b, val);
+    }
+  }
+
+  rgb.r = r;
+  rgb.g = g;
+  rgb.b = b;
+}
+
+CRGB& nblend(CRGB& existing, const CRGB& overlay, fract8 amountOfOverlay)
+{
+  if (amountOfOverlay == 0)
+    return existing;
+
+  if (amountOfOverlay == 255)
+  {
+    existing = overlay;
+    return existing;
+  }
+
+  existing.red = blend8(existing.red, overlay.red, amountOfOverlay);
+  existing.green = blend8(existing.green, overlay.green, amountOfOverlay);
+  existing.blue = blend8(existing.blue, overlay.blue, amountOfOverlay);
+  return existing;
+}
+
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2)
+{
+  CRGB nu(p1);
+  nblend(nu, p2, amountOfP2);
+  return nu;
+}
+
+void fill_solid(CRGB* targetArray, int numToFill, const CRGB& color)
+{
+  for (int i = 0; i < numToFill; ++i)
+    targetArray[i] = color;
+}
+
+void nscale8(CRGB* leds, uint16_t num_leds, uint8_t scale)
+{
+  for (uint16_t i = 0; i < num_leds; ++i)
+    leds[i].nscale8(scale);
+}
+
+void fadeToBlackBy(CRGB* leds, uint16_t num_leds, uint8_t fadeBy) { nscale8(leds, num_leds, 255 - fadeBy); }
+
+// ----------------------------------------------------------------
+// Palettes
+// ----------------------------------------------------------------
+extern const TProgmemRGBPalette16 CloudColors_p = {
+  CRGB::Blue, CRGB::DarkBlue, CRGB::DarkBlue, CRGB::DarkBlue,
+  CRGB::DarkBlue, CRGB::DarkBlue, CRGB::DarkBlue, CRGB::DarkBlue,
+  CRGB::Blue, CRGB::DarkBlue, CRGB::SkyBlue, CRGB::SkyBlue,
+  CRGB::LightBlue, CRGB::White, CRGB::LightBlue, CRGB::SkyBlue};
+
+extern const TProgmemRGBPalette16 LavaColors_p = {
+  CRGB::Black, CRGB::Maroon, CRGB::Black, CRGB::Maroon,
+  CRGB::DarkRed, CRGB::DarkRed, CRGB::Maroon, CRGB::DarkRed,
+  CRGB::DarkRed, CRGB::DarkRed, CRGB::Red, CRGB::Orange,
+  CRGB::White, CRGB::Orange, CRGB::Red, CRGB::DarkRed};
+
+extern const TProgmemRGBPalette16 OceanColors_p = {
+  CRGB::MidnightBlue, CRGB::DarkBlue, CRGB::MidnightBlue, CRGB::Navy,
+  CRGB::DarkBlue, CRGB::MediumBlue, CRGB::SeaGreen, CRGB::Teal,
+  CRGB::CadetBlue, CRGB::Blue, CRGB::DarkCyan, CRGB::CornflowerBlue,
+  CRGB::Aquamarine, CRGB::SeaGreen, CRGB::Aqua, CRGB::LightSkyBlue};
+
+extern const TProgmemRGBPalette16 ForestColors_p = {
+  CRGB::DarkGreen, CRGB::DarkGreen, CRGB::DarkOliveGreen, CRGB::DarkGreen,
+  CRGB::Green, CRGB::ForestGreen, CRGB::OliveDrab, CRGB::Green,
+  CRGB::SeaGreen, CRGB::MediumAquamarine, CRGB::LimeGreen, CRGB::YellowGreen,
+  CRGB::LightGreen, CRGB::LawnGreen, CRGB::MediumAquamarine, CRGB::ForestGreen};
+
+extern const TProgmemRGBPalette16 RainbowColors_p = {
+  0xFF0000, 0xD52A00, 0xAB5500, 0xAB7F00,
+  0xABAB00, 0x56D500, 0x00FF00, 0x00D52A,
+  0x00AB55, 0x0056AA, 0x0000FF, 0x2A00D5,
+  0x5500AB, 0x7F0081, 0xAB0055, 0xD5002B};
+
+extern const TProgmemRGBPalette16 PartyColors_p = {
+  0x5500AB, 0x84007C, 0xB5004B, 0xE5001B,
+  0xE81700, 0xB84700, 0xAB7700, 0xABAB00,
+  0xAB5500, 0xDD2200, 0xF2000E, 0xC2003E,
+  0x8F0071, 0x5F00A1, 0x2F00D0, 0x0007F9};
+
+extern const TProgmemRGBPalette16 HeatColors_p = {
+  0x000000,
+  0x330000, 0x660000, 0x990000, 0xCC0000, 0xFF0000,
+  0xFF3300, 0xFF6600, 0xFF9900, 0xFFCC00, 0xFFFF00,
+  0xFFFF33, 0xFFFF66, 0xFFFF99, 0xFFFFCC, 0xFFFFFF};
+
+/**
+ * The shared part of both ColorFromPalette()s: blend the palette entry iIndex falls in with the next one, then scale.
+ */
+static CRGB paletteColor(CRGB iEntry, CRGB iNext, uint8_t iIndex, uint8_t iBrightness, TBlendType iBlendType)
+{
+  uint8_t lo4 = iIndex & 0x0F;
+  uint8_t red1 = iEntry.red, green1 = iEntry.green, blue1 = iEntry.blue;
+
+  if (lo4 && iBlendType != NOBLEND)
+  {
+    uint8_t f2 = lo4 << 4;
+    uint8_t f1 = 255 - f2;
+    red1 = scale8(red1, f1) + scale8(iNext.red, f2);
+    green1 = scale8(green1, f1) + scale8(iNext.green, f2);
+    blue1 = scale8(blue1, f1) + scale8(iNext.blue, f2);
+  }
+
+  if (iBrightness != 255)
+  {
+    if (iBrightness)
+    {
+      ++iBrightness; // adjust for rounding
+      red1 = scale8(red1, iBrightness);
+      green1 = scale8(green1, iBrightness);
+      blue1 = scale8(blue1, iBrightness);
+    }
+    else
+      red1 = green1 = blue1 = 0;
+  }
+
+  return CRGB(red1, green1, blue1);
+}
+
+static uint8_t paletteIndex(uint8_t iIndex, TBlendType iBlendType)
+{
+  if (iBlendType == LINEARBLEND_NOWRAP)
+    return ((uint16_t)iIndex * 240) >> 8; // map8(iIndex, 0, 239)
+  return iIndex;
+}
+
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness, TBlendType blendType)
+{
+  index = paletteIndex(index, blendType);
+  uint8_t hi4 = index >> 4;
+  return paletteColor(pal[hi4], pal[(hi4 + 1) & 0x0F], index, brightness, blendType);
+}
+
+CRGB ColorFromPalette(const TProgmemRGBPalette16& pal, uint8_t index, uint8_t brightness, TBlendType blendType)
+{
+  index = paletteIndex(index, blendType);
+  uint8_t hi4 = index >> 4;
+  return paletteColor(pal[hi4], pal[(hi4 + 1) & 0x0F], index, brightness, blendType);
+}
+
+// ----------------------------------------------------------------
+// Controllers
+// ----------------------------------------------------------------
+CLEDController& CFastLED::addLeds(CLEDController* pLed, CRGB* data, int nLedsOrOffset, int nLedsIfOffset)
+{
+  int offset = (nLedsIfOffset > 0) ? nLedsOrOffset : 0;
+  int nLeds = (nLedsIfOffset > 0) ? nLedsIfOffset : nLedsOrOffset;
+  pLed->setLeds(data + offset, nLeds);
+
+  for (int i = 0; i < _count; ++i)
+    if (_controllers[i] == pLed)
+      return *pLed;
+  if (_count < maxControllers)
+    _controllers[_count++] = pLed;
+  return *pLed;
+}
+
+void CFastLED::show(uint8_t scale)
+{
+  for (int i = 0; i < _count; ++i)
+    _controllers[i]->showLeds(scale);
+  countFPS();
+}
+
+void CFastLED::clear(bool writeData)
+{
+  for (int i = 0; i < _count; ++i)
+    _controllers[i]->clearLedData();
+  if (writeData)
+    show(0);
+}
+
+void CFastLED::delay(unsigned long ms)
+{
+  unsigned long start = millis();
+  do
+  {
+    show();
+  } while ((millis() - start) < ms);
+}
+
+void CFastLED::countFPS(int nFrames)
+{
+  static int br = 0;
+  static uint32_t lastframe = 0;
+
+  if (br++ >= nFrames)
+  {
+    uint32_t now = millis();
+    now -= lastframe;
+    if (now == 0)
+      now = 1; // avoid div by 0
+    _fps = (br * 1000) / now;
+    br = 0;
+    lastframe = millis();
+  }
+}
@@ -0,0 +1,464 @@
+#pragma once
+
+// ----------------------------------------------------------------
+// The part of FastLED the sketch uses, for the host build (see host/Makefile).
+// The math follows FastLED 3.6's portable C code, with FASTLED_SCALE8_FIXED and FASTLED_BLEND_FIXED (its defaults), so
+// rendering gives the same pixels as on the Mega; AVR FastLED uses assembly for some of these, which computes the same
+// values. Controllers keep their pixel buffers, but show() sends them nowhere.
+// ----------------------------------------------------------------
+#include <Arduino.h>
+
+#define FASTLED_SCALE8_FIXED 1
+#define FASTLED_BLEND_FIXED 1
+
+#if defined(USE_GET_MILLISECOND_TIMER)
+uint32_t get_millisecond_timer();
+#define GET_MILLIS get_millisecond_timer
+#else
+#define GET_MILLIS millis
+#endif
+
+typedef uint8_t fract8;
+typedef uint16_t accum88;
+
+// ----------------------------------------------------------------
+// lib8tion
+// ----------------------------------------------------------------
+inline uint8_t qadd8(uint8_t i, uint8_t j)
+{
+  unsigned int t = i + j;
+  return t > 255 ? 255 : t;
+}
+
+inline uint8_t qsub8(uint8_t i, uint8_t j)
+{
+  int t = i - j;
+  return t < 0 ? 0 : t;
+}
+
+inline uint8_t scale8(uint8_t i, fract8 scale) { return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8; }
+inline uint8_t scale8_LEAVING_R1_DIRTY(uint8_t i, fract8 scale) { return scale8(i, scale); }
+inline void cleanup_R1() {}
+
+inline uint8_t scale8_video(uint8_t i, fract8 scale) { return (((int)i * (int)scale) >> 8) + ((i && scale) ? 1 : 0); }
+inline uint8_t scale8_video_LEAVING_R1_DIRTY(uint8_t i, fract8 scale) { return scale8_video(i, scale); }
+
+inline uint16_t scale16by8(uint16_t i, fract8 scale) { return ((uint32_t)i * (1 + (uint32_t)scale)) >> 8; }
+inline uint16_t scale16(uint16_t i, uint16_t scale) { return ((uint32_t)i * (1 + (uint32_t)scale)) / 65536; }
+
+inline void nscale8x3(uint8_t& r, uint8_t& g, uint8_t& b, fract8 scale)
+{
+  uint16_t scaleFixed = scale + 1;
+  r = ((uint16_t)r * scaleFixed) >> 8;
+  g = ((uint16_t)g * scaleFixed) >> 8;
+  b = ((uint16_t)b * scaleFixed) >> 8;
+}
+
+inline void nscale8x3_video(uint8_t& r, uint8_t& g, uint8_t& b, fract8 scale)
+{
+  uint8_t nonzeroscale = (scale != 0) ? 1 : 0;
+  r = (r == 0) ? 0 : (((int)r * (int)scale) >> 8) + nonzeroscale;
+  g = (g == 0) ? 0 : (((int)g * (int)scale) >> 8) + nonzeroscale;
+  b = (b == 0) ? 0 : (((int)b * (int)scale) >> 8) + nonzeroscale;
+}
+
+inline uint8_t lerp8by8(uint8_t a, uint8_t b, fract8 frac)
+{
+  if (b > a)
+    return a + scale8(b - a, frac);
+  return a - scale8(a - b, frac);
+}
+
+inline uint8_t blend8(uint8_t a, uint8_t b, uint8_t amountOfB)
+{
+  uint16_t partial = (a << 8) | b; // a * 257
+  partial += b * amountOfB;
+  partial -= a * amountOfB;
+  return partial >> 8;
+}
+
+inline uint8_t triwave8(uint8_t in)
+{
+  if (in & 0x80)
+    in = 255 - in;
+  return in << 1;
+}
+
+inline uint8_t sin8(uint8_t theta)
+{
+  static const uint8_t b_m16_interleave[] = {0, 49, 49, 41, 90, 27, 117, 10};
+
+  uint8_t offset = theta;
+  if (theta & 0x40)
+    offset = (uint8_t)255 - offset;
+  offset &= 0x3F; // 0..63
+
+  uint8_t secoffset = offset & 0x0F; // 0..15
+  if (theta & 0x40)
+    ++secoffset;
+
+  uint8_t section = offset >> 4; // 0..3
+  uint8_t b = b_m16_interleave[section * 2];
+  uint8_t m16 = b_m16_interleave[section * 2 + 1];
+
+  uint8_t mx = (m16 * secoffset) >> 4;
+
+  int8_t y = mx + b;
+  if (theta & 0x80)
+    y = -y;
+  y += 128;
+  return y;
+}
+
+inline uint8_t cos8(uint8_t theta) { return sin8(theta + 64); }
+
+inline int16_t sin16(uint16_t theta)
+{
+  static const uint16_t base[] = {0, 6393, 12539, 18204, 23170, 27245, 30273, 32137};
+  static const uint8_t slope[] = {49, 48, 44, 38, 31, 23, 14, 4};
+
+  uint16_t offset = (theta & 0x3FFF) >> 3; // 0..2047
+  if (theta & 0x4000)
+    offset = 2047 - offset;
+
+  uint8_t section = offset / 256; // 0..7
+  uint16_t b = base[section];
+  uint8_t m = slope[section];
+
+  uint8_t secoffset8 = (uint8_t)offset / 2;
+
+  uint16_t mx = m * secoffset8;
+  int16_t y = mx + b;
+  if (theta & 0x8000)
+    y = -y;
+  return y;
+}
+
+inline int16_t cos16(uint16_t theta) { return sin16(theta + 16384); }
+
+inline uint16_t beat88(accum88 beats_per_minute_88, uint32_t timebase = 0)
+{
+  return ((GET_MILLIS() - timebase) * beats_per_minute_88 * 280) >> 16;
+}
+
+inline uint16_t beat16(accum88 beats_per_minute, uint32_t timebase = 0)
+{
+  if (beats_per_minute < 256)
+    beats_per_minute <<= 8;
+  return beat88(beats_per_minute, timebase);
+}
+
+inline uint8_t beat8(accum88 beats_per_minute, uint32_t timebase = 0) { return beat16(beats_per_minute, timebase) >> 8; }
+
+inline uint16_t beatsin88(accum88 beats_per_minute_88, uint16_t lowest = 0, uint16_t highest = 65535, uint32_t timebase = 0, uint16_t phase_offset = 0)
+{
+  uint16_t beat = beat88(beats_per_minute_88, timebase);
+  uint16_t beatsin = sin16(beat + phase_offset) + 32768;
+  uint16_t rangewidth = highest - lowest;
+  return lowest + scale16(beatsin, rangewidth);
+}
+
+inline uint16_t beatsin16(accum88 beats_per_minute, uint16_t lowest = 0, uint16_t highest = 65535, uint32_t timebase = 0, uint16_t phase_offset = 0)
+{
+  uint16_t beat = beat16(beats_per_minute, timebase);
+  uint16_t beatsin = sin16(beat + phase_offset) + 32768;
+  uint16_t rangewidth = highest - lowest;
+  return lowest + scale16(beatsin, rangewidth);
+}
+
+inline uint8_t beatsin8(accum88 beats_per_minute, uint8_t lowest = 0, uint8_t highest = 255, uint32_t timebase = 0, uint8_t phase_offset = 0)
+{
+  uint8_t beat = beat8(beats_per_minute, timebase);
+  uint8_t beatsin = sin8(beat + phase_offset);
+  uint8_t rangewidth = highest - lowest;
+  return lowest + scale8(beatsin, rangewidth);
+}
+
+extern uint16_t rand16seed;
+
+inline uint8_t random8()
+{
+  rand16seed = (rand16seed * 2053) + 13849;
+  return (uint8_t)(rand16seed & 0xFF) + (uint8_t)(rand16seed >> 8);
+}
+
+inline uint8_t random8(uint8_t lim) { return (random8() * lim) >> 8; }
+inline uint8_t random8(uint8_t min, uint8_t lim) { return random8(lim - min) + min; }
+
+inline uint16_t random16()
+{
+  rand16seed = (rand16seed * 2053) + 13849;
+  return rand16seed;
+}
+
+inline void memset8(void* ptr, uint8_t value, uint16_t num) { memset(ptr, value, num); }
+inline void memcpy8(void* dst, const void* src, uint16_t num) { memcpy(dst, src, num); }
+
+// ----------------------------------------------------------------
+// Colors
+// ----------------------------------------------------------------
+struct CHSV
+{
+  union
+  {
+    struct
+    {
+      union { uint8_t hue; uint8_t h; };
+      union { uint8_t saturation; uint8_t sat; uint8_t s; };
+      union { uint8_t value; uint8_t val; uint8_t v; };
+    };
+    uint8_t raw[3];
+  };
+
+  CHSV() {}
+  CHSV(uint8_t ih, uint8_t is, uint8_t iv) : h(ih), s(is), v(iv) {}
+};
+
+enum LEDColorCorrection
+{
+  TypicalSMD5050 = 0xFFB0F0,
+  TypicalLEDStrip = 0xFFB0F0,
+  UncorrectedColor = 0xFFFFFF
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV& hsv, CRGB& rgb);
+
+struct CRGB
+{
+  union
+  {
+    struct
+    {
+      union { uint8_t r; uint8_t red; };
+      union { uint8_t g; uint8_t green; };
+      union { uint8_t b; uint8_t blue; };
+    };
+    uint8_t raw[3];
+  };
+
+  // the colors the sketch and the built in palettes use
+  enum HTMLColorCode
+  {
+    Aqua = 0x00FFFF,
+    Aquamarine = 0x7FFFD4,
+    Black = 0x000000,
+    Blue = 0x0000FF,
+    CadetBlue = 0x5F9EA0,
+    CornflowerBlue = 0x6495ED,
+    DarkBlue = 0x00008B,
+    DarkCyan = 0x008B8B,
+    DarkGreen = 0x006400,
+    DarkOliveGreen = 0x556B2F,
+    DarkRed = 0x8B0000,
+    ForestGreen = 0x228B22,
+    Green = 0x008000,
+    LawnGreen = 0x7CFC00,
+    LightBlue = 0xADD8E6,
+    LightGreen = 0x90EE90,
+    LightSkyBlue = 0x87CEFA,
+    LimeGreen = 0x32CD32,
+    Maroon = 0x800000,
+    MediumAquamarine = 0x66CDAA,
+    MediumBlue = 0x0000CD,
+    MidnightBlue = 0x191970,
+    Navy = 0x000080,
+    OliveDrab = 0x6B8E23,
+    Orange = 0xFFA500,
+    Red = 0xFF0000,
+    SeaGreen = 0x2E8B57,
+    SkyBlue = 0x87CEEB,
+    Teal = 0x008080,
+    White = 0xFFFFFF,
+    YellowGreen = 0x9ACD32
+  };
+
+  CRGB() {}
+  CRGB(uint8_t ir, uint8_t ig, uint8_t ib) : r(ir), g(ig), b(ib) {}
+  CRGB(uint32_t colorcode) : r((colorcode >> 16) & 0xFF), g((colorcode >> 8) & 0xFF), b(colorcode & 0xFF) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+  CRGB(LEDColorCorrection colorcode) : CRGB((uint32_t)colorcode) {}
+  CRGB(const CHSV& rhs) { hsv2rgb_rainbow(rhs, *this); }
+
+  CRGB& operator=(const CHSV& rhs)
+  {
+    hsv2rgb_rainbow(rhs, *this);
+    return *this;
+  }
+
+  uint8_t& operator[](uint8_t x) { return raw[x]; }
+  const uint8_t& operator[](uint8_t x) const { return raw[x]; }
+
+  CRGB& operator+=(const CRGB& rhs)
+  {
+    r = qadd8(r, rhs.r);
+    g = qadd8(g, rhs.g);
+    b = qadd8(b, rhs.b);
+    return *this;
+  }
+
+  CRGB& operator-=(const CRGB& rhs)
+  {
+    r = qsub8(r, rhs.r);
+    g = qsub8(g, rhs.g);
+    b = qsub8(b, rhs.b);
+    return *this;
+  }
+
+  CRGB& operator|=(const CRGB& rhs)
+  {
+    r = max(r, rhs.r);
+    g = max(g, rhs.g);
+    b = max(b, rhs.b);
+    return *this;
+  }
+
+  CRGB& nscale8(uint8_t scaledown)
+  {
+    nscale8x3(r, g, b, scaledown);
+    return *this;
+  }
+
+  CRGB& nscale8_video(uint8_t scaledown)
+  {
+    nscale8x3_video(r, g, b, scaledown);
+    return *this;
+  }
+
+  CRGB& fadeToBlackBy(uint8_t fadefactor)
+  {
+    nscale8x3(r, g, b, 255 - fadefactor);
+    return *this;
+  }
+
+  uint8_t getAverageLight() const { return scale8(r, 85) + scale8(g, 85) + scale8(b, 85); }
+};
+
+inline bool operator==(const CRGB& lhs, const CRGB& rhs) { return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b; }
+inline bool operator!=(const CRGB& lhs, const CRGB& rhs) { return !(lhs == rhs); }
+inline CRGB operator+(const CRGB& p1, const CRGB& p2) { return CRGB(qadd8(p1.r, p2.r), qadd8(p1.g, p2.g), qadd8(p1.b, p2.b)); }
+
+CRGB& nblend(CRGB& existing, const CRGB& overlay, fract8 amountOfOverlay);
+CRGB blend(const CRGB& p1, const CRGB& p2, fract8 amountOfP2);
+
+void fill_solid(CRGB* targetArray, int numToFill, const CRGB& color);
+void nscale8(CRGB* leds, uint16_t num_leds, uint8_t scale);
+void fadeToBlackBy(CRGB* leds, uint16_t num_leds, uint8_t fadeBy);
+
+// ----------------------------------------------------------------
+// Palettes
+// ----------------------------------------------------------------
+typedef uint32_t TProgmemRGBPalette16[16];
+
+enum TBlendType
+{
+  NOBLEND = 0,
+  LINEARBLEND = 1,
+  LINEARBLEND_NOWRAP = 2
+};
+
+class CRGBPalette16
+{
+public:
+  CRGB entries[16];
+
+  CRGBPalette16(const TProgmemRGBPalette16& rhs)
+  {
+    for (uint8_t i = 0; i < 16; ++i)
+      entries[i] = rhs[i];
+  }
+
+  CRGBPalette16(const CRGB& c00, const CRGB& c01, const CRGB& c02, const CRGB& c03,
+                const CRGB& c04, const CRGB& c05, const CRGB& c06, const CRGB& c07,
+                const CRGB& c08, const CRGB& c09, const CRGB& c10, const CRGB& c11,
+                const CRGB& c12, const CRGB& c13, const CRGB& c14, const CRGB& c15)
+    : entries{c00, c01, c02, c03, c04, c05, c06, c07, c08, c09, c10, c11, c12, c13, c14, c15}
+  {
+  }
+
+  CRGB& operator[](uint8_t x) { return entries[x]; }
+  const CRGB& operator[](uint8_t x) const { return entries[x]; }
+};
+
+CRGB ColorFromPalette(const CRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType blendType = LINEARBLEND);
+CRGB ColorFromPalette(const TProgmemRGBPalette16& pal, uint8_t index, uint8_t brightness = 255, TBlendType blendType = LINEARBLEND);
+
+extern const TProgmemRGBPalette16 CloudColors_p, LavaColors_p, OceanColors_p, ForestColors_p, RainbowColors_p, PartyColors_p, HeatColors_p;
+
+// ----------------------------------------------------------------
+// Controllers
+// ----------------------------------------------------------------
+enum EOrder
+{
+  RGB = 0012,
+  GRB = 0102
+};
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER = GRB>
+class WS2812B
+{
+};
+
+class CLEDController
+{
+  CRGB* _leds = nullptr;
+  int _numLeds = 0;
+
+public:
+  void setLeds(CRGB* data, int nLeds)
+  {
+    _leds = data;
+    _numLeds = nLeds;
+  }
+
+  void showLeds(uint8_t brightness = 255) {}
+  void showColor(const CRGB& data, int nLeds, uint8_t brightness = 255) {}
+  void clearLedData()
+  {
+    if (_leds)
+      memset((void*)_leds, 0, sizeof(CRGB) * _numLeds);
+  }
+
+  CLEDController& setCorrection(LEDColorCorrection correction) { return *this; }
+  CLEDController& setCorrection(CRGB correction) { return *this; }
+
+  CRGB* leds() { return _leds; }
+  int size() { return _numLeds; }
+};
+
+class CFastLED
+{
+  static const int maxControllers = 16;
+
+  CLEDController* _controllers[maxControllers];
+  int _count = 0;
+  uint8_t _brightness = 255;
+  uint16_t _fps = 0;
+
+  CLEDController& addLeds(CLEDController* pLed, CRGB* data, int nLedsOrOffset, int nLedsIfOffset);
+
+public:
+  template <template <uint8_t DATA_PIN, EOrder RGB_ORDER> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  CLEDController& addLeds(CRGB* data, int nLedsOrOffset, int nLedsIfOffset = 0)
+  {
+    static CLEDController c; // one per chipset and pin, like FastLED's
+    return addLeds(&c, data, nLedsOrOffset, nLedsIfOffset);
+  }
+
+  void show() { show(_brightness); }
+  void show(uint8_t scale);
+  void clear(bool writeData = false);
+  void delay(unsigned long ms);
+
+  void setBrightness(uint8_t scale) { _brightness = scale; }
+  uint8_t getBrightness() { return _brightness; }
+  void setMaxRefreshRate(uint16_t refresh, bool constrain = false) {}
+
+  void countFPS(int nFrames = 25);
+  uint16_t getFPS() { return _fps; }
+
+  int count() { return _count; }
+  CLEDController& operator[](int x) { return *_controllers[x]; }
+};
+
+extern CFastLED FastLED;
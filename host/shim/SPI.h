@@ -0,0 +1,11 @@
+#pragma once
+
+#include <Arduino.h>
+
+class SPIClass
+{
+public:
+  void begin() {}
+};
+
+extern SPIClass SPI;
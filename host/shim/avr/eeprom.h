@@ -0,0 +1,5 @@
+#pragma once
+
+#include <Arduino.h>
+
+#define eeprom_is_ready() 1 // EEPROM writes are instant here, see EEPROM.h
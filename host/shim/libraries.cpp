@@ -0,0 +1,5 @@
+#include "EEPROM.h"
+#include "SPI.h"
+
+EEPROMClass EEPROM;
+SPIClass SPI;
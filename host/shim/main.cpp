@@ -0,0 +1,9 @@
+#include "Arduino.h"
+
+// the Arduino core's main(), for builds of the whole sketch
+int main()
+{
+  setup();
+  for (;;)
+    loop();
+}
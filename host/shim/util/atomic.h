@@ -0,0 +1,5 @@
+#pragma once
+
+// nothing interrupts the host build
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_BLOCK(type) for (bool _atomicOnce = true; _atomicOnce; _atomicOnce = false)
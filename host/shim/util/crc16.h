@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+// the C equivalents given in avr-libc's documentation
+
+static inline uint16_t _crc16_update(uint16_t iCRC, uint8_t iData)
+{
+  iCRC ^= iData;
+  for (uint8_t i = 0; i < 8; ++i)
+    iCRC = (iCRC & 1) ? (iCRC >> 1) ^ 0xA001 : (iCRC >> 1);
+  return iCRC;
+}
+
+static inline uint16_t _crc_ccitt_update(uint16_t iCRC, uint8_t iData)
+{
+  iData ^= iCRC & 0xFF;
+  iData ^= iData << 4;
+  return ((((uint16_t)iData << 8) | (iCRC >> 8)) ^ (uint8_t)(iData >> 4) ^ ((uint16_t)iData << 3));
+}
+
+static inline uint16_t _crc_xmodem_update(uint16_t iCRC, uint8_t iData)
+{
+  iCRC = iCRC ^ ((uint16_t)iData << 8);
+  for (uint8_t i = 0; i < 8; ++i)
+    iCRC = (iCRC & 0x8000) ? (iCRC << 1) ^ 0x1021 : (iCRC << 1);
+  return iCRC;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "lights.h"
+
+// ----------------------------------------------------------------
+// Compile-time list of every light object, and of its concrete type.
+// Per frame work (setup(), update(), show(), outputChecksum()) goes through forEach(), which calls a visitor with each
+// light as its own type: every call is resolved at compile time, and can be inlined and specialised per light type,
+// instead of going through ILight's vtable (which, on AVR, also lives in SRAM). Those functions aren't part of ILight at
+// all; any light type listed here must provide them.
+// ILight stays the runtime interface, for whatever picks a light by index at runtime: button selection, and light
+// indices in tags and serial commands. interfaces[] lists the same lights, in the same order, for those.
+//
+// Usage:
+//   typedef LightRegistry<LIGHT_ENTRY(windows), LIGHT_ENTRY(starfield)> Lights;
+//   struct UpdateLight { template <typename L> void operator()(L& ioLight, byte iIndex) { ioLight.update(); } };
+//   UpdateLight visitor;
+//   Lights::forEach(visitor);
+// ----------------------------------------------------------------
+
+/**
+ * A light object, Object, of type Type; use LIGHT_ENTRY() to list one in a LightRegistry.
+ */
+template <typename Type, Type& Object>
+struct LightEntry
+{
+  static Type& object() { return Object; }
+};
+
+#define LIGHT_ENTRY(object) LightEntry<decltype(object), object>
+
+// the lights of a registry, from the Indexth one on
+template <byte Index, typename... Entries>
+struct LightRegistryList;
+
+template <byte Index>
+struct LightRegistryList<Index>
+{
+  template <typename Visitor>
+  static void forEach(Visitor&) {}
+};
+
+template <byte Index, typename First, typename... Rest>
+struct LightRegistryList<Index, First, Rest...>
+{
+  template <typename Visitor>
+  static void forEach(Visitor& ioVisitor)
+  {
+    ioVisitor(First::object(), Index);
+    LightRegistryList<Index + 1, Rest...>::forEach(ioVisitor);
+  }
+};
+
+template <typename... Entries>
+struct LightRegistry
+{
+  static constexpr byte count = sizeof...(Entries);
+
+  static ILight* interfaces[sizeof...(Entries)];
+
+  /**
+   * Call ioVisitor(light, index) on every light, in order; ioVisitor's call operator should be a template, to be called
+   * with each light's concrete type.
+   */
+  template <typename Visitor>
+  static void forEach(Visitor& ioVisitor)
+  {
+    LightRegistryList<0, Entries...>::forEach(ioVisitor);
+  }
+};
+
+template <typename... Entries>
+ILight* LightRegistry<Entries...>::interfaces[sizeof...(Entries)] = {&Entries::object()...};
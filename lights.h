@@ -1,11 +1,15 @@
 #pragma once
 
+#include "clock.h"
+#include "profiler.h"
 #include "quakeFlicker.h"
 #include "pacifica.h"
+#include "patternVM.h"
 #include "LED_functions.h"
-
-// TODO
-// * It would likely make sense, and make this code simpler, to separate conceptual lights and physical light controllers
+#include "overlay.h"
+#include "transition.h"
+#include "clickTrain.h"
+#include "stripLayout.h"
 
 /**
  * Data structure for serialization of a light's settings
@@ -19,11 +23,18 @@ struct LightDataBlock {
 
 // ----------------------------------------------------------------
 // ILight interface to be used to refer to all lights
+// Only what's needed to pick a light at runtime (buttons, tags, serial commands) is virtual. Per frame work is dispatched
+// statically, through a LightRegistry (see lightRegistry.h), so every light type must also provide:
+//   void setup();
+//   bool update(); // perform some sort of update step for this light; returns true if it actually changed any state
+//   bool show();   // push whatever update() changed out to the hardware; returns true if anything was actually sent out
+//   uint16_t outputChecksum(uint16_t crc); // MW_REPLAY only: fold the light's output into a running CRC, see replay.h
 // ----------------------------------------------------------------
 class ILight
 {
 protected:
   byte _selectedPatternID = 0;
+  OverlayStack _overlays; // composited over the light's normal output by update()
 
 public:
   bool _cycleColor = false;
@@ -35,28 +46,41 @@ public:
   byte getSelectedPattern() { return _selectedPatternID; };
 
   /**
-   * Switch to the next pattern in the available patterns. To be implemented by derived class based on how they actually implement patterns!
+   * Number of patterns this light supports; valid pattern IDs are 0 to patternCount() - 1.
+   * To be implemented by derived class based on how they actually implement patterns!
+   */
+  virtual byte patternCount() = 0;
+
+  /**
+   * Switch to the next pattern in the available patterns, wrapping around after the last one.
    */
-  virtual byte nextPattern() = 0;
+  byte nextPattern()
+  {
+    beginTransition(MW_TRANSITION_DEFAULT);
+    _selectedPatternID = (_selectedPatternID + 1) % patternCount();
+    return _selectedPatternID;
+  };
 
   /**
-   * Perform some sort of update step for this light.
-   * Returns true if the upate actually changed any state. Callers should do with that information what they will for performance reasons!
-   * 
-   * Derived classes should call their base class (which will call it's own, etc.) and check the returned value.
+   * Called right before the light's pattern or color changes, to crossfade from what it showed to what it shows next,
+   * over iDuration (in MW_TRANSITION_UNIT ms; 0 to cut). Lights that can't crossfade just cut.
    */
-  virtual bool update() = 0;
+  virtual void beginTransition(byte iDuration) {};
 
   /**
-   * 
+   * Default show(), for lights whose update() already writes to the hardware.
    */
-  virtual void setup() = 0;
+  bool show() { return false; };
 
   /**
-   * Pulse light briefly, to indicate it is in programming mode. This is a BLOCKING operation by design, to simplify having to deal with existing patterns.
-   * Each subclass is in charge of implementing some way to do this and not interfere with anything.
+   * Pulse light briefly, to indicate it is in programming mode.
+   * This only starts an overlay blinking the light on top of its pattern; update() composites it in over the next frames,
+   * so nothing blocks, and the pattern carries on underneath.
    */
-  virtual void pulse() = 0;
+  virtual void pulse()
+  {
+    _overlays.push(OVERLAY_EFFECT_BLINK, OVERLAY_BLEND_REPLACE, CRGB::White, 200, 800);
+  };
 
   void serialize(LightDataBlock* ioDataBlock)
   {
@@ -66,13 +90,29 @@ public:
     ioDataBlock->saturation = _saturation;
   };
 
-  void deserialize(LightDataBlock* iDataBlock)
+  /**
+   * Apply serialized settings, crossfading over iTransition (see beginTransition()). A pattern ID this light doesn't
+   * support is ignored, and the current pattern kept.
+   */
+  void deserialize(const LightDataBlock* iDataBlock, byte iTransition = MW_TRANSITION_DEFAULT)
   {
+    beginTransition(iTransition);
     _cycleColor = iDataBlock->cycleColor;
-    _selectedPatternID = iDataBlock->patternID;
+    if (iDataBlock->patternID < patternCount())
+      _selectedPatternID = iDataBlock->patternID;
     _hue = iDataBlock->hue;
     _saturation = iDataBlock->saturation;
   }
+
+  /**
+   * Whether applying these serialized settings would leave this light as it is. The hue of a light cycling colors is
+   * ignored, since it's bound to have moved on from whatever was last applied.
+   */
+  bool matches(const LightDataBlock* iDataBlock)
+  {
+    return _cycleColor == iDataBlock->cycleColor && _selectedPatternID == iDataBlock->patternID && _saturation == iDataBlock->saturation
+        && (_cycleColor || _hue == iDataBlock->hue);
+  }
 };
 
 // ----------------------------------------------------------------
@@ -82,19 +122,23 @@ template <bool colorSupport>
 class Light : public ILight
 {
 private:
-  uint16_t _lastColorCycleUpdate = 0;
+  uint32_t _lastColorCycleUpdate = 0;
 
 public:
-  virtual bool update() { return false; };
-  virtual void setup() {};
+  /**
+   * Derived classes should call their base class (which will call its own, etc.). Returns true if color cycling moved
+   * the hue; lights that animate every frame anyway may ignore it.
+   */
+  bool update() { return false; };
+  void setup() {};
 };
 
 template <>
 bool Light<true>::update()
 {
-  uint16_t now = millis();
+  uint32_t now = clockMillis();
 
-  if ((uint8_t)(now - _lastColorCycleUpdate) > 20)
+  if (now - _lastColorCycleUpdate > 20)
   { // don't cycle colors too fast when button is held
     _lastColorCycleUpdate = now;
     if (_cycleColor) {
@@ -103,13 +147,13 @@ bool Light<true>::update()
     }
   }
 
-  return true;
+  return false;
 };
 
 template <>
 void Light<true>::setup()
 {
-  _lastColorCycleUpdate = millis();
+  _lastColorCycleUpdate = clockMillis();
 };
 
 // ----------------------------------------------------------------
@@ -121,148 +165,184 @@ class PatternLight : public Light<colorSupport>
 protected:
   byte _patternStep = 0;
   byte _prevPatternID = 0;
-  uint16_t _lastLightUpdate = 0;
+  uint32_t _lastLightUpdate = 0;
 
 public:
-  virtual byte nextPattern() {
-    this->_selectedPatternID = ++(this->_selectedPatternID) % NUM_LIGHTSTYLES;
-  };
+  virtual byte patternCount() { return NUM_LIGHTSTYLES; };
 
-  virtual bool update()
+  /**
+   * Compute the next animation frame; the _val it computes may still be the same as the previous one. Frames are paced
+   * by the scheduler (see MW_FRAME_INTERVAL), so there is always a frame to compute; derived classes are in charge of
+   * figuring out whether their actual output changed.
+   */
+  void update()
   {
     Light<colorSupport>::update(); // safe to ignore whether or not color cycling made any changes; we'll determine if we wanna skip updating on our own, for animation purposes
-    uint16_t now = millis();
-
-    if ((uint8_t)(now - _lastLightUpdate) < 16)
-    { // no need to update faster than 60FPS
-      return false;
-    }
 
-    if (this->_selectedPatternID < NUM_LIGHTSTYLES) // don't perform Quake style flicker if we're out of range of those; we'll do Pacifica instead
+    if (this->_selectedPatternID < NUM_LIGHTSTYLES) // don't perform Quake style flicker if we're out of range of those; we'll do Pacifica or a pattern program instead
       this->_val = enhancedQuakeFlicker(this->_lastLightUpdate, this->_selectedPatternID, this->_prevPatternID, this->_patternStep);
-    
-    return true;
   };
 
-  virtual void setup()
+  void setup()
   {
     Light<colorSupport>::setup();
-    _lastLightUpdate = millis();
-    ;
+    _lastLightUpdate = clockMillis();
   };
 };
 
 // ----------------------------------------------------------------
 // A PatternLight on one or more WS2812B LED string (with color)
-// Support up to three strips; strips can be of different lengths.
-// See constructor for hackish details of multiple strip support.
-//
-// TODO: handling of multiple strips is pretty hackish and gross, but
-// at this point I don't want to clean it up for MW3. Maybe for MW4!
-//
+// The strips are described by Layout, a StripLayout (see stripLayout.h); they can be of different lengths, and map onto
+// segments of the light, possibly reversed or mirrored.
+// All strips show the same pattern: a single logical buffer, holding only the unique pixels, is rendered once per frame,
+// then mapped onto the strips. The buffers are static, and provided by an LEDArena.
 // ----------------------------------------------------------------
-template <int dataPin1, int dataPin2=0, int dataPin3=0>
+template <typename Layout>
 class PatternLightLEDStrip : public PatternLight<true>
 {
-  int _numLEDs1;
-  int _numLEDs2;
-  int _numLEDs3;
-  CRGB *_leds1 = nullptr;
-  CRGB *_leds2 = nullptr;
-  CRGB *_leds3 = nullptr;
+  static const uint16_t _numLEDs = Layout::bufferLEDs; // unique pixels, i.e. size of _leds
+  CRGB *_leds; // logical buffer, followed by the physical buffers of strips that aren't views of it
+  CLEDController *_controllers[Layout::count];
+  byte _firstController = 0; // index of _controllers[0] in FastLED, for the profiler
+
+  Pacifica _pacifica;
+  PatternVM _vm;
+  uint16_t _spatialTime = 0; // where spatial Quake styles are, see advanceSpatialLightstyle()
+  uint32_t _lastSpatialUpdate = 0;
+  Transition<(_numLEDs < MW_TRANSITION_SNAPSHOT_PIXELS ? _numLEDs : MW_TRANSITION_SNAPSHOT_PIXELS)> _transition;
 
   byte _maxBrightness = 255;
 
+  // Output state:
+  // - when _solidFill is set (any Quake style, unless crossfading), every strip is uniformly _solidColor; the pixel buffers are NOT kept up to date,
+  //   show() streams that one color to the strips instead. Buffers are only rendered into by spatial patterns, i.e. all others.
+  // - _dirtyStrips has bit N set when the output of _controllers[N] changed since it was last shown
+  byte _dirtyStrips = 0;
+  bool _solidFill = false;
+  CRGB _solidColor;
+
+  static const byte allStrips = (1 << Layout::count) - 1;
+
 public:
-  // Number of LEDs in the strip is optional if strips 2 and 3 are present. For any of strip 2 or 3 where the number of LEDs is not specified, two things will happen:
-  // - the number of LEDs from strip 1 will be used
-  // - the buffer for strip 1 will be reused
-  PatternLightLEDStrip(int numLEDs1, int numLEDs2=0, int numLEDs3=0) : _numLEDs1(numLEDs1), _numLEDs2(numLEDs2), _numLEDs3(numLEDs3)
-  {
-    if (!_numLEDs2)
-        _numLEDs2 = _numLEDs1;
-    if (!_numLEDs3)
-        _numLEDs3 = _numLEDs1;
-  };
+  // iLEDs: buffer of Layout::bufferLEDs + Layout::physicalLEDs LEDs, e.g. from LEDArena::buffer()
+  PatternLightLEDStrip(CRGB *iLEDs) : _leds(iLEDs) {};
 
   void setMaxBrightness(byte maxBrightness)
   {
     _maxBrightness = maxBrightness;
   };
 
-  virtual byte nextPattern()
+  // Quake styles first, then Pacifica, which is not handled by the quakeFlicker code, then pattern programs, then spatial Quake styles
+  static const byte PATTERN_ID_PACIFICA = NUM_LIGHTSTYLES;
+  static const byte PATTERN_ID_PROGRAMS = PATTERN_ID_PACIFICA + 1;
+  static const byte PATTERN_ID_SPATIAL = PATTERN_ID_PROGRAMS + NUM_PATTERN_PROGRAMS;
+
+  virtual byte patternCount() { return PATTERN_ID_SPATIAL + NUM_SPATIAL_LIGHTSTYLES; };
+
+  void beginTransition(byte iDuration)
   {
-    this->_selectedPatternID = ++(this->_selectedPatternID) % (NUM_LIGHTSTYLES + 1); // add one to support Pacifica as an additional style, which is not handled by the quakeFlicker code
+    if (!iDuration)
+      return;
+    if (_solidFill)
+      _transition.begin(_solidColor, iDuration);
+    else
+      _transition.begin(_leds, _numLEDs, iDuration);
   };
 
   void setup()
   {
-    _leds1 = new CRGB[_numLEDs1];
-    FastLED.addLeds<WS2812B, dataPin1, GRB>(_leds1, _numLEDs1).setCorrection(TypicalLEDStrip);
-    if (dataPin2)
-    {
-      if (_numLEDs2 != _numLEDs1)
-        _leds2 = new CRGB[_numLEDs2];
-
-      FastLED.addLeds<WS2812B, dataPin2, GRB>(_numLEDs2 == _numLEDs1 ? _leds1 : _leds2, _numLEDs2).setCorrection(TypicalLEDStrip);
-    }
-    if (dataPin3)
-    {
-      if (_numLEDs3 != _numLEDs1)
-        _leds3 = new CRGB[_numLEDs3];
-
-      FastLED.addLeds<WS2812B, dataPin3, GRB>(_numLEDs3 == _numLEDs1 ? _leds1 : _leds3, _numLEDs3).setCorrection(TypicalLEDStrip);
-    }
+    _firstController = FastLED.count();
+    Layout::addControllers(_leds, _leds + _numLEDs, _controllers);
 
     PatternLight::setup();
   };
 
   bool update()
   {
-    if (PatternLight::update())
+    PatternLight::update();
+
+    uint32_t now = clockMillis();
+    bool overlaid = _overlays.update(now);
+
+    if (_selectedPatternID < NUM_LIGHTSTYLES && !_transition.active())
+    {
+      CRGB color = CHSV(_hue, _saturation, scale8_video(_val, _maxBrightness));
+      if (overlaid)
+        color = _overlays.composite(color, now);
+      if (_solidFill && color == _solidColor)
+        return false; // most Quake style steps don't change anything; nothing to do until the next one
+
+      _solidFill = true;
+      _solidColor = color;
+    }
+    else
     {
       if (_selectedPatternID < NUM_LIGHTSTYLES)
+        fill_solid(_leds, _numLEDs, CHSV(_hue, _saturation, scale8_video(_val, _maxBrightness)));
+      else if (_selectedPatternID == PATTERN_ID_PACIFICA)
+      {
+        _pacifica.advance();
+        _pacifica.render(_leds, _numLEDs);
+      }
+      else if (_selectedPatternID >= PATTERN_ID_SPATIAL)
       {
-        byte scaledVal = scale8_video(_val, _maxBrightness);
-        setAllLEDs(CHSV(_hue, _saturation, scaledVal), _leds1, _numLEDs1);
-        if (_leds2)
-          setAllLEDs(CHSV(_hue, _saturation, scaledVal), _leds2, _numLEDs2);
-        if (_leds3)
-          setAllLEDs(CHSV(_hue, _saturation, scaledVal), _leds3, _numLEDs3);
+        byte spatialID = _selectedPatternID - PATTERN_ID_SPATIAL;
+        advanceSpatialLightstyle(_lastSpatialUpdate, _spatialTime, spatialID);
+        renderSpatialLightstyle(spatialID, _spatialTime, CHSV(_hue, _saturation, _maxBrightness), _leds, _numLEDs);
       }
       else
       {
-        pacifica_loop(_leds1, _numLEDs1);
-        if (_leds2)
-          pacifica_loop(_leds2, _numLEDs2);
-        if (_leds3)
-          pacifica_loop(_leds3, _numLEDs3);
+        _vm.select(_selectedPatternID - PATTERN_ID_PROGRAMS);
+        _vm.run(_leds, _numLEDs, _hue, _saturation, _maxBrightness);
+      }
+      if (_transition.active())
+        _transition.blend(_leds, _numLEDs, now);
+      if (overlaid)
+      {
+        for (int i = 0; i < _numLEDs; ++i)
+          _leds[i] = _overlays.composite(_leds[i], now);
       }
+      Layout::map(_leds, _leds + _numLEDs);
+      _solidFill = false;
     }
 
+    _dirtyStrips = allStrips; // either the solid color changed, or the buffer all strips map from was rendered into
     return true;
   };
 
-  void pulse()
+  /**
+   * Clock out the strips that changed since they were last shown; bit banging a 230 LED strip takes ~7ms, so skipping clean ones matters.
+   */
+  bool show()
   {
-    for (byte i = 0; i < 4; ++i)
+    if (!_dirtyStrips)
+      return false;
+
+    for (byte i = 0; i < Layout::count; ++i)
     {
-      setAllLEDs(CRGB::White, _leds1, _numLEDs1);
-      if (_leds2)
-        setAllLEDs(CRGB::White, _leds2, _numLEDs2);
-      if (_leds3)
-        setAllLEDs(CRGB::White, _leds3, _numLEDs3);
-      FastLED.show();
-      delay(100);
-      setAllLEDs(CRGB::Black, _leds1, _numLEDs1);
-      if (_leds2)
-        setAllLEDs(CRGB::Black, _leds2, _numLEDs2);
-      if (_leds3)
-        setAllLEDs(CRGB::Black, _leds3, _numLEDs3);
-      FastLED.show();
-      delay(100);
+      if (!(_dirtyStrips & (1 << i)))
+        continue;
+
+      if (_solidFill)
+        _controllers[i]->showColor(_solidColor, _controllers[i]->size(), FastLED.getBrightness());
+      else
+        _controllers[i]->showLeds(FastLED.getBrightness());
+      PROFILE_MARK(PROFILE_STAGE_SHOW(_firstController + i));
     }
+    _dirtyStrips = 0;
+    return true;
+  };
+
+#ifdef MW_REPLAY
+  uint16_t outputChecksum(uint16_t crc)
+  {
+    // checksum what is actually sent out; a solid fill is identical to what a filled buffer would give
+    for (byte i = 0; i < Layout::count; ++i)
+      crc = _solidFill ? checksumColor(crc, _solidColor, _controllers[i]->size()) : checksumLEDs(crc, _controllers[i]->leds(), _controllers[i]->size());
+    return crc;
   };
+#endif
+
 };
 
 // ----------------------------------------------------------------
@@ -271,6 +351,7 @@ public:
 class PatternLightPWMPort : public PatternLight<false>
 {
   int _pin;
+  byte _shownVal = 0;
 
 public:
   PatternLightPWMPort(int pin) : _pin(pin){};
@@ -285,24 +366,22 @@ public:
 
   bool update()
   {
-    if (PatternLight::update())
-    {
-      analogWrite(_pin, _val);
-    }
+    PatternLight::update();
+
+    uint32_t now = clockMillis();
+    byte val = _overlays.update(now) ? _overlays.composite(_val, now) : _val;
+    if (val == _shownVal)
+      return false;
 
+    analogWrite(_pin, val);
+    _shownVal = val;
     return true;
   };
 
-  void pulse()
-  {
-    for (byte i = 0; i < 4; ++i)
-    {
-      analogWrite(_pin, 255);
-      delay(100);
-      analogWrite(_pin, 0);
-      delay(100);
-    }
-  };
+#ifdef MW_REPLAY
+  uint16_t outputChecksum(uint16_t crc) { return _crc16_update(crc, _shownVal); };
+#endif
+
 };
 
 // ----------------------------------------------------------------
@@ -312,6 +391,7 @@ public:
 class PatternLightDigitalPort : public PatternLight<false>
 {
   int _pin;
+  byte _shownVal = 0;
 
 public:
   PatternLightDigitalPort(int pin) : _pin(pin){};
@@ -326,30 +406,29 @@ public:
 
   bool update()
   {
-    if (PatternLight::update())
-    {
-      digitalWrite(_pin, _val);
-    }
+    PatternLight::update();
+
+    uint32_t now = clockMillis();
+    byte val = _overlays.update(now) ? _overlays.composite(_val, now) : _val;
+    if (val == _shownVal)
+      return false;
 
+    digitalWrite(_pin, val);
+    _shownVal = val;
     return true;
   };
 
-  void pulse()
-  {
-    for (byte i = 0; i < 4; ++i)
-    {
-      digitalWrite(_pin, HIGH);
-      delay(100);
-      digitalWrite(_pin, LOW);
-      delay(100);
-    }
-  };
+#ifdef MW_REPLAY
+  uint16_t outputChecksum(uint16_t crc) { return _crc16_update(crc, _shownVal); };
+#endif
+
 };
 
 
 // ----------------------------------------------------------------
 // A type of fairy lights that come with their own controllers
-// We'll just use a data pin to simulate clicking the button.
+// We'll just use a data pin to simulate clicking the button; the clicks are sent in the background by fairyClickTrain,
+// so there can only be one of these.
 // ----------------------------------------------------------------
 class FairyLightsController : public ILight
 {
@@ -358,7 +437,7 @@ class FairyLightsController : public ILight
   byte _offPatternID;
   byte _onPatternID;
 
-  byte _prevPatternID = 0;
+  byte _targetPatternID = 0; // pattern the fairy lights will be on once the clicks queued so far are sent
 
   byte patternDistance(byte currentPattern, byte desiredPattern)
   {
@@ -366,52 +445,53 @@ class FairyLightsController : public ILight
     return distance < 0 ? distance + _numPatternsAvailable : distance;
   };
 
-  void clickFairyLights(byte numClicks) {
-    for (byte i = 0; i < numClicks; ++i) {
-      digitalWrite(_pin, LOW);
-      delay(40);
-      digitalWrite(_pin, HIGH);
-      delay(40);
+  /**
+   * Retarget the click train: whatever clicks it hasn't started yet are replaced by the shortest sequence from where
+   * the lights will be once the click in progress is done, to iPatternID. Rapid changes thus never queue stale clicks.
+   */
+  void clickTowards(byte iPatternID)
+  {
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+      byte position = (_targetPatternID + _numPatternsAvailable - fairyClickTrain.queued()) % _numPatternsAvailable;
+      fairyClickTrain.setQueued(patternDistance(position, iPatternID));
     }
+    _targetPatternID = iPatternID;
   }
 
 public:
   FairyLightsController(int pin, byte numPatternsAvailable=9, byte offPatternID=0, byte onPatternID=8) : _pin(pin), _numPatternsAvailable(numPatternsAvailable), _offPatternID(offPatternID), _onPatternID(onPatternID) {};
 
-  virtual bool update()
+  bool update()
   {
-    if (_selectedPatternID != _prevPatternID)
+    // while pulsing, the overlay toggles between the on and off patterns instead of a color
+    byte targetPatternID = _selectedPatternID;
+    uint32_t now = clockMillis();
+    if (_overlays.update(now))
+      targetPatternID = _overlays.composite((byte)0, now) ? _onPatternID : _offPatternID;
+
+    if (targetPatternID != _targetPatternID)
     {
-      byte distance = patternDistance(_prevPatternID, _selectedPatternID);
-      //Serial.print("updating FL controller, distance between SelectedID (#"); Serial.print(_selectedPatternID); Serial.print(") and previousID (#"); Serial.print(_prevPatternID); Serial.print(") is "); Serial.println(distance);
-      clickFairyLights(distance);
-      _prevPatternID = _selectedPatternID;
+      //Serial.print("updating FL controller, from targetID (#"); Serial.print(_targetPatternID); Serial.print(") to targetID (#"); Serial.print(targetPatternID); Serial.println(")");
+      clickTowards(targetPatternID);
       return true;
     }
     return false;
   };
 
-  virtual void setup()
+  void setup()
   {
-    pinMode(_pin, OUTPUT);
-    digitalWrite(_pin, HIGH);
+    fairyClickTrain.setup(_pin);
   };
 
-  // NB this probably needs to move to some base class shared with PatternLight but I can't be bothered right now
-  virtual byte nextPattern() {
-    this->_selectedPatternID = ++(this->_selectedPatternID) % _numPatternsAvailable;
-  };
+#ifdef MW_REPLAY
+  uint16_t outputChecksum(uint16_t crc) { return _crc16_update(crc, _targetPatternID); };
+#endif
+
+  virtual byte patternCount() { return _numPatternsAvailable; };
 
   void pulse()
   {
-    clickFairyLights(patternDistance(_selectedPatternID, _onPatternID));
-    for (byte i = 0; i < 2; ++i)
-    {
-      delay(500);
-      clickFairyLights(patternDistance(_onPatternID, _offPatternID));
-      delay(300);
-      clickFairyLights(patternDistance(_offPatternID, _onPatternID));
-    }
-    clickFairyLights(patternDistance(_onPatternID, _selectedPatternID));
+    _overlays.push(OVERLAY_EFFECT_BLINK, OVERLAY_BLEND_REPLACE, CRGB::White, 800, 1600); // the fairy lights' own controller is too slow to blink any faster
   };
 };
@@ -0,0 +1,284 @@
+#pragma once
+
+#include <MFRC522.h>
+
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Deferred binary event log.
+// Logging an event appends its ID and raw argument bytes to a ring buffer in RAM, which is much cheaper than formatting
+// it, and never waits on Serial. drain() then sends whole records from loop(), as COBS frames delimited by 0x00 on both
+// ends (like serialControl.h), and only as much as the Serial TX buffer can take without blocking, so logging never stalls
+// rendering. If the ring buffer fills up, new events are dropped and counted, and the count is logged once there's room.
+//
+// A decoded frame is LOG_FRAME_MARKER, the event ID, then its arguments; tools/decode_log.py turns a capture of Serial
+// back into text, reading the events and their formats from LOG_EVENTS below. Plain text printed on Serial goes through as is.
+// With MW_LOG_TEXT, drain() formats records on target instead, for use with a plain serial monitor.
+//
+// Format strings only live in flash. Their arguments are:
+//  - %u: byte, in decimal
+//  - %U: uint16_t, in decimal
+//  - %b: LogBytes, as { 0x01, 0x02 }
+//  - %h: LogBytes, as  01 02 (each byte with a leading space)
+//  - %m: MFRC522::StatusCode, by name
+//  - %p: MFRC522::PICC_Type, by name
+// Event IDs are their position in LOG_EVENTS, so only ever add events at the end, to keep old captures decodable.
+// ----------------------------------------------------------------
+#define LOG_EVENTS(X) \
+  X(LOG_DROPPED, "(%U log events dropped)") \
+  X(LOG_TAG_DETECTED, "Tag ID: %b - PICC type: %p") \
+  X(LOG_TAG_UNSUPPORTED, "Unsupported PICC type; please use MIFARE Classic tags.") \
+  X(LOG_TAG_READ_FAILED, "Internal failure in RFID reader: %m while reading block #%u") \
+  X(LOG_TAG_BLOCK_READ, "Data in block #%u:%h") \
+  X(LOG_TAG_VERSION_UNSUPPORTED, "Unsupported tag format version %u") \
+  X(LOG_TAG_TRUNCATED, "Tag data truncated.") \
+  X(LOG_TAG_CRC_MISMATCH, "Tag data CRC mismatch; ignoring tag.") \
+  X(LOG_TAG_UNRECOGNIZED, "Unrecognized tag data; ignoring tag.") \
+  X(LOG_TAG_INVALID_PATTERN, "Invalid pattern for light #%u; ignoring tag.") \
+  X(LOG_TAG_APPLIED_CACHED, "Programmed lights with cached tag data.") \
+  X(LOG_TAG_APPLIED, "Programmed lights with tag data.") \
+  X(LOG_TAG_WRITE_BLOCK, "lightsData block #%u is:%h") \
+  X(LOG_TAG_WRITING, "Writing data to tag...") \
+  X(LOG_TAG_WRITE_FAILED, "Internal failure while writing to tag: %m") \
+  X(LOG_TAG_WRITTEN, "Wrote lights data to tag.") \
+  X(LOG_TASK_LATE, "Task #%u started %U ms late.") \
+  X(LOG_BUTTONS_DROPPED, "Button queue full; button changes dropped.")
+
+enum LogEvent : byte
+{
+#define LOG_EVENT_ID(id, format) id,
+  LOG_EVENTS(LOG_EVENT_ID)
+#undef LOG_EVENT_ID
+  LOG_EVENT_COUNT
+};
+
+#define LOG_EVENT_FORMAT(id, format) const char id##_FORMAT[] PROGMEM = format;
+LOG_EVENTS(LOG_EVENT_FORMAT)
+#undef LOG_EVENT_FORMAT
+
+const char* const logFormats[LOG_EVENT_COUNT] PROGMEM = {
+#define LOG_EVENT_FORMAT_NAME(id, format) id##_FORMAT,
+  LOG_EVENTS(LOG_EVENT_FORMAT_NAME)
+#undef LOG_EVENT_FORMAT_NAME
+};
+
+#define LOG_FRAME_MARKER 0xFF // first byte of a decoded log frame; never the first byte of printable text
+#define LOG_MAX_RECORD 24     // event ID and arguments; larger events are dropped
+#define LOG_MAX_FRAME (LOG_MAX_RECORD + 4) // with the marker, the COBS code byte and both delimiters
+
+static_assert(MW_LOG_BUFFER_SIZE <= 128 && (MW_LOG_BUFFER_SIZE & (MW_LOG_BUFFER_SIZE - 1)) == 0, "MW_LOG_BUFFER_SIZE must be a power of 2, up to 128");
+static_assert(MW_LOG_DRAIN_BYTES_PER_FRAME >= LOG_MAX_FRAME, "MW_LOG_DRAIN_BYTES_PER_FRAME must fit the largest log frame");
+static_assert(LOG_MAX_FRAME < SERIAL_TX_BUFFER_SIZE, "log frames must fit in the Serial TX buffer, or they would never be sent");
+
+/**
+ * A byte array argument, logged with its length.
+ */
+struct LogBytes
+{
+  const byte* data;
+  byte length;
+};
+
+#ifdef MW_LOG_TEXT
+// byte array formats of print(), below
+void printHex(const byte* buffer, byte bufferSize)
+{
+  Serial.print("{ ");
+  for (byte i = 0; i < bufferSize; i++) {
+    Serial.print("0x");
+    Serial.print(buffer[i] < 0x10 ? "0" : "");
+    Serial.print(buffer[i], HEX);
+    Serial.print((i == bufferSize-1) ? " }" : ", ");
+  }
+}
+
+void dump_byte_array(const byte* buffer, byte bufferSize)
+{
+  for (byte i = 0; i < bufferSize; i++)
+  {
+    Serial.print(buffer[i] < 0x10 ? " 0" : " ");
+    Serial.print(buffer[i], HEX);
+  }
+}
+#endif
+
+class EventLog
+{
+  byte _buffer[MW_LOG_BUFFER_SIZE]; // records: size of what follows, event ID, arguments
+  byte _head = 0;                   // where the next record goes
+  byte _tail = 0;                   // oldest record
+  byte _used = 0;
+  uint16_t _dropped = 0;
+
+  void put(byte iByte)
+  {
+    _buffer[_head] = iByte;
+    _head = (_head + 1) & (MW_LOG_BUFFER_SIZE - 1);
+  }
+
+  byte peek(byte iOffset) { return _buffer[(_tail + iOffset) & (MW_LOG_BUFFER_SIZE - 1)]; }
+
+  static byte argSize() { return 0; }
+
+  template <typename T, typename... Args>
+  static byte argSize(const T&, const Args&... iArgs) { return sizeof(T) + argSize(iArgs...); }
+
+  template <typename... Args>
+  static byte argSize(const LogBytes& iBytes, const Args&... iArgs) { return 1 + iBytes.length + argSize(iArgs...); }
+
+  void putArgs() {}
+
+  template <typename T, typename... Args>
+  void putArgs(const T& iArg, const Args&... iArgs)
+  {
+    const byte* bytes = (const byte*)&iArg; // little endian, like AVR itself
+    for (byte i = 0; i < sizeof(T); ++i)
+      put(bytes[i]);
+    putArgs(iArgs...);
+  }
+
+  template <typename... Args>
+  void putArgs(const LogBytes& iBytes, const Args&... iArgs)
+  {
+    put(iBytes.length);
+    for (byte i = 0; i < iBytes.length; ++i)
+      put(iBytes.data[i]);
+    putArgs(iArgs...);
+  }
+
+  void pop(byte iSize)
+  {
+    _tail = (_tail + 1 + iSize) & (MW_LOG_BUFFER_SIZE - 1);
+    _used -= 1 + iSize;
+  }
+
+#ifdef MW_LOG_TEXT
+  static void print(const byte* iRecord)
+  {
+    const char* format = (const char*)pgm_read_ptr(logFormats + iRecord[0]);
+    const byte* arg = iRecord + 1;
+    for (char c = pgm_read_byte(format++); c; c = pgm_read_byte(format++))
+    {
+      if (c != '%')
+      {
+        Serial.print(c);
+        continue;
+      }
+
+      switch (pgm_read_byte(format++))
+      {
+      case 'u':
+        Serial.print(arg[0]);
+        arg += 1;
+        break;
+      case 'U':
+        Serial.print(arg[0] | (arg[1] << 8));
+        arg += 2;
+        break;
+      case 'b':
+        printHex(arg + 1, arg[0]);
+        arg += 1 + arg[0];
+        break;
+      case 'h':
+        dump_byte_array(arg + 1, arg[0]);
+        arg += 1 + arg[0];
+        break;
+      case 'm':
+        Serial.print(MFRC522::GetStatusCodeName((MFRC522::StatusCode)arg[0]));
+        arg += 1;
+        break;
+      case 'p':
+        Serial.print(MFRC522::PICC_GetTypeName((MFRC522::PICC_Type)arg[0]));
+        arg += 1;
+        break;
+      }
+    }
+    Serial.println();
+  }
+#endif
+
+public:
+  /**
+   * Log an event. Arguments are copied as raw bytes, so they must match the types expected by the event's format.
+   */
+  template <typename... Args>
+  void event(LogEvent iEvent, const Args&... iArgs)
+  {
+    byte size = 1 + argSize(iArgs...);
+
+    if (_dropped && _used + 4 + 1 + size <= MW_LOG_BUFFER_SIZE) // room for a LOG_DROPPED record, and this one
+    {
+      uint16_t dropped = _dropped;
+      _dropped = 0;
+      event(LOG_DROPPED, dropped);
+    }
+
+    if (size > LOG_MAX_RECORD || _used + 1 + size > MW_LOG_BUFFER_SIZE)
+    {
+      if (_dropped < UINT16_MAX)
+        ++_dropped;
+      return;
+    }
+
+    put(size);
+    put(iEvent);
+    putArgs(iArgs...);
+    _used += 1 + size;
+  }
+
+  /**
+   * Send the oldest records on Serial, up to MW_LOG_DRAIN_BYTES_PER_FRAME bytes, and only whole records that fit in the
+   * TX buffer, so this never blocks, and log frames never get interleaved with anything else printed on Serial.
+   * Call once per loop() iteration.
+   */
+  void drain()
+  {
+    byte budget = MW_LOG_DRAIN_BYTES_PER_FRAME;
+    while (_used)
+    {
+      byte size = peek(0);
+      byte record[LOG_MAX_RECORD];
+      for (byte i = 0; i < size; ++i)
+        record[i] = peek(1 + i);
+
+#ifdef MW_LOG_TEXT
+      if (Serial.availableForWrite() < budget) // text is longer than the record, and may still block briefly
+        return;
+      print(record);
+      pop(size);
+      return; // one record per call
+#else
+      byte frameSize = size + 4;
+      if (frameSize > budget || frameSize > Serial.availableForWrite())
+        return;
+
+      byte frame[LOG_MAX_FRAME];
+      byte length = 0;
+      frame[length++] = 0x00;
+      byte code = length++;
+      frame[length++] = LOG_FRAME_MARKER;
+      for (byte i = 0; i < size; ++i)
+      {
+        if (record[i] == 0x00)
+        {
+          frame[code] = length - code;
+          code = length++;
+        }
+        else
+          frame[length++] = record[i];
+      }
+      frame[code] = length - code;
+      frame[length++] = 0x00;
+
+      Serial.write(frame, length);
+      budget -= frameSize;
+#endif
+      pop(size);
+    }
+  }
+};
+
+EventLog eventLog;
+
+template <typename... Args>
+inline void logEvent(LogEvent iEvent, const Args&... iArgs) { eventLog.event(iEvent, iArgs...); }
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <FastLED.h>
+
+#include "clock.h"
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Timed overlays, composited over a light's normal output.
+// Each light owns a small stack of them. An overlay has a start time, a duration, an effect (how its level evolves over
+// time) and a blend mode (how it combines with what's below it), and is composited by the light's own update() on every
+// frame until it expires, so other lights keep animating in the meantime. This is what pulse() uses.
+// ----------------------------------------------------------------
+enum OverlayEffect : byte
+{
+  OVERLAY_EFFECT_BLINK,   // full level for the first half of each period, then 0 for the second half
+  OVERLAY_EFFECT_TRIANGLE // ramps from 0 to full level and back down over each period
+};
+
+enum OverlayBlend : byte
+{
+  OVERLAY_BLEND_REPLACE, // output is the overlay color, scaled by the level; what's below is ignored
+  OVERLAY_BLEND_ADD,     // overlay color, scaled by the level, is added to what's below
+  OVERLAY_BLEND_MIX      // output fades from what's below to the overlay color, as the level goes up
+};
+
+struct Overlay
+{
+  uint32_t start;    // clockMillis() when the overlay started
+  uint16_t duration; // ms
+  uint16_t period;   // ms, for the effect
+  CRGB color;
+  OverlayEffect effect;
+  OverlayBlend blend;
+};
+
+class OverlayStack
+{
+  Overlay _overlays[MW_OVERLAY_STACK_DEPTH];
+  byte _count = 0;
+
+  static byte level(const Overlay& iOverlay, uint16_t iElapsed)
+  {
+    uint16_t phase = iElapsed % iOverlay.period;
+    switch (iOverlay.effect)
+    {
+    case OVERLAY_EFFECT_BLINK:
+      return phase < iOverlay.period / 2 ? 255 : 0;
+    case OVERLAY_EFFECT_TRIANGLE:
+    default:
+      return triwave8(((uint32_t)phase << 8) / iOverlay.period);
+    }
+  }
+
+  static CRGB blend(const CRGB& iBelow, const Overlay& iOverlay, byte iLevel)
+  {
+    switch (iOverlay.blend)
+    {
+    case OVERLAY_BLEND_REPLACE:
+      return CRGB(iOverlay.color).nscale8_video(iLevel);
+    case OVERLAY_BLEND_ADD:
+      return iBelow + CRGB(iOverlay.color).nscale8_video(iLevel);
+    case OVERLAY_BLEND_MIX:
+    default:
+      return ::blend(iBelow, iOverlay.color, iLevel);
+    }
+  }
+
+public:
+  /**
+   * Start a new overlay on top of the stack, now. If the stack is full, the oldest overlay is dropped to make room.
+   */
+  void push(OverlayEffect iEffect, OverlayBlend iBlend, const CRGB& iColor, uint16_t iPeriod, uint16_t iDuration)
+  {
+    if (_count == MW_OVERLAY_STACK_DEPTH)
+    {
+      memmove(_overlays, _overlays + 1, sizeof(Overlay) * (MW_OVERLAY_STACK_DEPTH - 1));
+      --_count;
+    }
+
+    Overlay& overlay = _overlays[_count++];
+    overlay.start = clockMillis();
+    overlay.duration = iDuration;
+    overlay.period = iPeriod;
+    overlay.color = iColor;
+    overlay.effect = iEffect;
+    overlay.blend = iBlend;
+  }
+
+  /**
+   * Drop the overlays that ran their course. Returns true if any overlay is still running.
+   */
+  bool update(uint32_t iNow)
+  {
+    byte kept = 0;
+    for (byte i = 0; i < _count; ++i)
+    {
+      if (iNow - _overlays[i].start < _overlays[i].duration)
+        _overlays[kept++] = _overlays[i];
+    }
+    _count = kept;
+    return _count;
+  }
+
+  bool active() { return _count; }
+
+  /**
+   * Composite all running overlays, bottom to top, over iBelow. Overlays must have been update()d at iNow, so they're
+   * all less than their duration in.
+   */
+  CRGB composite(CRGB iBelow, uint32_t iNow)
+  {
+    for (byte i = 0; i < _count; ++i)
+      iBelow = blend(iBelow, _overlays[i], level(_overlays[i], (uint16_t)(iNow - _overlays[i].start)));
+    return iBelow;
+  }
+
+  /**
+   * Same as above, for lights without color: overlay colors only count for their average light.
+   */
+  byte composite(byte iBelow, uint32_t iNow)
+  {
+    if (!_count)
+      return iBelow;
+    return composite(CRGB(iBelow, iBelow, iBelow), iNow).getAverageLight();
+  }
+};
@@ -2,6 +2,8 @@
 
 #include <FastLED.h>
 
+#include "compileTime.h"
+
 //////////////////////////////////////////////////////////////////////////
 //
 // The code for this animation is more complicated than other examples, and 
@@ -27,19 +29,116 @@
 // These three custom blue-green color palettes were inspired by the colors found in
 // the waters off the southern coast of California, https://goo.gl/maps/QQgd97jjHesHZVxQ7
 //
-CRGBPalette16 pacifica_palette_1 = 
+constexpr TProgmemRGBPalette16 pacifica_palette_1 PROGMEM =
     { 0x000507, 0x000409, 0x00030B, 0x00030D, 0x000210, 0x000212, 0x000114, 0x000117, 
       0x000019, 0x00001C, 0x000026, 0x000031, 0x00003B, 0x000046, 0x14554B, 0x28AA50 };
-CRGBPalette16 pacifica_palette_2 = 
+constexpr TProgmemRGBPalette16 pacifica_palette_2 PROGMEM =
     { 0x000507, 0x000409, 0x00030B, 0x00030D, 0x000210, 0x000212, 0x000114, 0x000117, 
       0x000019, 0x00001C, 0x000026, 0x000031, 0x00003B, 0x000046, 0x0C5F52, 0x19BE5F };
-CRGBPalette16 pacifica_palette_3 = 
+constexpr TProgmemRGBPalette16 pacifica_palette_3 PROGMEM =
     { 0x000208, 0x00030E, 0x000514, 0x00061A, 0x000820, 0x000927, 0x000B2D, 0x000C33, 
       0x000E39, 0x001040, 0x001450, 0x001860, 0x001C70, 0x002080, 0x1040BF, 0x2060FF };
 
+// ----------------------------------------------------------------
+// 256 entry lookup tables of the palettes above, expanded at compile time into PROGMEM.
+// Entry N is ColorFromPalette(palette, N, 255, LINEARBLEND), using the exact same blend math as FastLED; the brightness
+// scaling is then done at runtime by pacificaColorFromLUT(), again exactly like ColorFromPalette() does it.
+// ----------------------------------------------------------------
+struct PacificaLUTEntry { uint8_t r, g, b; };
+struct PacificaLUTRow { PacificaLUTEntry entries[16]; };
+struct PacificaLUT { PacificaLUTRow rows[16]; };
+
+constexpr uint8_t pacificaScale8(uint8_t i, uint8_t scale)
+{
+#if (FASTLED_SCALE8_FIXED == 1)
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+#else
+  return ((uint16_t)i * scale) >> 8;
+#endif
+}
+
+constexpr uint8_t pacificaPaletteChannel(const TProgmemRGBPalette16& p, uint8_t index, uint8_t shift)
+{
+  return (index & 0x0F) == 0 ? (uint8_t)(p[index >> 4] >> shift)
+                             : (uint8_t)(pacificaScale8(p[index >> 4] >> shift, 255 - ((index & 0x0F) << 4)) + pacificaScale8(p[((index >> 4) + 1) & 0x0F] >> shift, (index & 0x0F) << 4));
+}
+
+template <uint8_t... Lo>
+constexpr PacificaLUTRow pacificaLUTRow(const TProgmemRGBPalette16& p, uint8_t hi, IndexSequence<Lo...>)
+{
+  return PacificaLUTRow{{ {pacificaPaletteChannel(p, hi * 16 + Lo, 16), pacificaPaletteChannel(p, hi * 16 + Lo, 8), pacificaPaletteChannel(p, hi * 16 + Lo, 0)}... }};
+}
+
+template <uint8_t... Hi>
+constexpr PacificaLUT pacificaLUT(const TProgmemRGBPalette16& p, IndexSequence<Hi...>)
+{
+  return PacificaLUT{{ pacificaLUTRow(p, Hi, MakeIndexSequence<16>::type())... }};
+}
+
+constexpr PacificaLUT pacificaLUT1 PROGMEM = pacificaLUT(pacifica_palette_1, MakeIndexSequence<16>::type());
+constexpr PacificaLUT pacificaLUT2 PROGMEM = pacificaLUT(pacifica_palette_2, MakeIndexSequence<16>::type());
+constexpr PacificaLUT pacificaLUT3 PROGMEM = pacificaLUT(pacifica_palette_3, MakeIndexSequence<16>::type());
+
+// Same result as ColorFromPalette(palette, iIndex, iBri, LINEARBLEND), for the palette iLUT was built from
+inline CRGB pacificaColorFromLUT(const PacificaLUT* iLUT, uint8_t iIndex, uint8_t iBri)
+{
+  const uint8_t* entry = (const uint8_t*)iLUT + iIndex * sizeof(PacificaLUTEntry);
+  uint8_t r = pgm_read_byte(entry);
+  uint8_t g = pgm_read_byte(entry + 1);
+  uint8_t b = pgm_read_byte(entry + 2);
+
+  if (iBri != 255)
+  {
+    if (iBri)
+    {
+      ++iBri; // adjust for rounding
+      if (r)
+      {
+        r = scale8(r, iBri);
+#if !(FASTLED_SCALE8_FIXED == 1)
+        ++r;
+#endif
+      }
+      if (g)
+      {
+        g = scale8(g, iBri);
+#if !(FASTLED_SCALE8_FIXED == 1)
+        ++g;
+#endif
+      }
+      if (b)
+      {
+        b = scale8(b, iBri);
+#if !(FASTLED_SCALE8_FIXED == 1)
+        ++b;
+#endif
+      }
+    }
+    else
+    {
+      r = g = b = 0;
+    }
+  }
+
+  return CRGB(r, g, b);
+}
+
+// One pixel's worth of one wave layer: step the layer's angles along the strip, and look up its color
+inline CRGB pacificaLayerStep(uint16_t& ioWaveAngle, uint16_t& ioCI, uint16_t iWaveScaleHalf, const PacificaLUT* iLUT, uint8_t iBri)
+{
+  ioWaveAngle += 250;
+  uint16_t s16 = sin16( ioWaveAngle ) + 32768;
+  uint16_t cs = scale16( s16 , iWaveScaleHalf ) + iWaveScaleHalf;
+  ioCI += cs;
+  uint16_t sindex16 = sin16( ioCI) + 32768;
+  return pacificaColorFromLUT(iLUT, scale16( sindex16, 240), iBri);
+}
+
+#ifdef MW_BENCHMARK
+// The original multi-pass renderer, kept as a reference for the benchmarks to check the fused kernel against
 
 // Add one layer of waves into the led array
-void pacifica_one_layer(CRGB* iLEDs, uint16_t iNumLEDs, CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff)
+void pacifica_one_layer(CRGB* iLEDs, uint16_t iNumLEDs, const CRGBPalette16& p, uint16_t cistart, uint16_t wavescale, uint8_t bri, uint16_t ioff)
 {
   uint16_t ci = cistart;
   uint16_t waveangle = ioff;
@@ -57,11 +156,8 @@ void pacifica_one_layer(CRGB* iLEDs, uint16_t iNumLEDs, CRGBPalette16& p, uint16
 }
 
 // Add extra 'white' to areas where the four layers of light have lined up brightly
-void pacifica_add_whitecaps(CRGB* iLEDs, uint16_t iNumLEDs)
+void pacifica_add_whitecaps(CRGB* iLEDs, uint16_t iNumLEDs, uint8_t basethreshold, uint8_t wave)
 {
-  uint8_t basethreshold = beatsin8( 9, 55, 65);
-  uint8_t wave = beat8( 7 );
-  
   for( uint16_t i = 0; i < iNumLEDs; i++) {
     uint8_t threshold = scale8( sin8( wave), 20) + basethreshold;
     wave += 7;
@@ -83,38 +179,120 @@ void pacifica_deepen_colors(CRGB* iLEDs, uint16_t iNumLEDs)
     iLEDs[i] |= CRGB( 2, 5, 7);
   }
 }
+#endif // MW_BENCHMARK
 
-void pacifica_loop(CRGB* iLEDs, uint16_t iNumLEDs)
+// ----------------------------------------------------------------
+// One running instance of the Pacifica animation.
+// Each light gets its own, so two lights running Pacifica don't fight over the wave state (which used to be function statics).
+// advance() moves the animation forward once per frame; render() can then be called any number of times during that
+// frame, for any number of LEDs, and always draws the same frame. A light should render its longest strip once, and show
+// its shorter strips as views into that render.
+// ----------------------------------------------------------------
+class Pacifica
 {
-  // Increment the four "color index start" counters, one for each wave layer.
-  // Each is incremented at a different speed, and the speeds vary over time.
-  static uint16_t sCIStart1, sCIStart2, sCIStart3, sCIStart4;
-  static uint32_t sLastms = 0;
-  uint32_t ms = GET_MILLIS();
-  uint32_t deltams = ms - sLastms;
-  sLastms = ms;
-  uint16_t speedfactor1 = beatsin16(3, 179, 269);
-  uint16_t speedfactor2 = beatsin16(4, 179, 269);
-  uint32_t deltams1 = (deltams * speedfactor1) / 256;
-  uint32_t deltams2 = (deltams * speedfactor2) / 256;
-  uint32_t deltams21 = (deltams1 + deltams2) / 2;
-  sCIStart1 += (deltams1 * beatsin88(1011,10,13));
-  sCIStart2 -= (deltams21 * beatsin88(777,8,11));
-  sCIStart3 -= (deltams1 * beatsin88(501,5,7));
-  sCIStart4 -= (deltams2 * beatsin88(257,4,6));
-
-  // Clear out the LED array to a dim background blue-green
-  fill_solid(iLEDs, iNumLEDs, CRGB( 2, 6, 10));
-
-  // Render each of four layers, with different scales and speeds, that vary over time
-  pacifica_one_layer(iLEDs, iNumLEDs, pacifica_palette_1, sCIStart1, beatsin16( 3, 11 * 256, 14 * 256), beatsin8( 10, 70, 130), 0-beat16( 301) );
-  pacifica_one_layer(iLEDs, iNumLEDs, pacifica_palette_2, sCIStart2, beatsin16( 4,  6 * 256,  9 * 256), beatsin8( 17, 40,  80), beat16( 401) );
-  pacifica_one_layer(iLEDs, iNumLEDs, pacifica_palette_3, sCIStart3, 6 * 256, beatsin8( 9, 10,38), 0-beat16(503));
-  pacifica_one_layer(iLEDs, iNumLEDs, pacifica_palette_3, sCIStart4, 5 * 256, beatsin8( 8, 10,28), beat16(601));
-
-  // Add brighter 'whitecaps' where the waves lines up more
-  pacifica_add_whitecaps(iLEDs, iNumLEDs);
-
-  // Deepen the blues and greens a bit
-  pacifica_deepen_colors(iLEDs, iNumLEDs);
-}
+  // The four "color index start" counters, one for each wave layer
+  uint16_t _ciStart1 = 0, _ciStart2 = 0, _ciStart3 = 0, _ciStart4 = 0;
+  uint32_t _lastms = 0;
+
+  // Per-frame layer and whitecap parameters, sampled once by advance()
+  uint16_t _waveScale1 = 0, _waveScale2 = 0;
+  uint8_t _bri1 = 0, _bri2 = 0, _bri3 = 0, _bri4 = 0;
+  uint16_t _ioff1 = 0, _ioff2 = 0, _ioff3 = 0, _ioff4 = 0;
+  uint8_t _whitecapThreshold = 0, _whitecapWave = 0;
+
+public:
+  void advance()
+  {
+    // Increment the four "color index start" counters, one for each wave layer.
+    // Each is incremented at a different speed, and the speeds vary over time.
+    uint32_t ms = GET_MILLIS();
+    uint32_t deltams = ms - _lastms;
+    _lastms = ms;
+    uint16_t speedfactor1 = beatsin16(3, 179, 269);
+    uint16_t speedfactor2 = beatsin16(4, 179, 269);
+    uint32_t deltams1 = (deltams * speedfactor1) / 256;
+    uint32_t deltams2 = (deltams * speedfactor2) / 256;
+    uint32_t deltams21 = (deltams1 + deltams2) / 2;
+    _ciStart1 += (deltams1 * beatsin88(1011,10,13));
+    _ciStart2 -= (deltams21 * beatsin88(777,8,11));
+    _ciStart3 -= (deltams1 * beatsin88(501,5,7));
+    _ciStart4 -= (deltams2 * beatsin88(257,4,6));
+
+    // Each of four layers has different scales and speeds, that vary over time
+    _waveScale1 = beatsin16( 3, 11 * 256, 14 * 256);
+    _waveScale2 = beatsin16( 4,  6 * 256,  9 * 256);
+    _bri1 = beatsin8( 10, 70, 130);
+    _bri2 = beatsin8( 17, 40,  80);
+    _bri3 = beatsin8( 9, 10,38);
+    _bri4 = beatsin8( 8, 10,28);
+    _ioff1 = 0-beat16( 301);
+    _ioff2 = beat16( 401);
+    _ioff3 = 0-beat16(503);
+    _ioff4 = beat16(601);
+
+    _whitecapThreshold = beatsin8( 9, 55, 65);
+    _whitecapWave = beat8( 7 );
+  }
+
+  /**
+   * Fused single pass kernel: for each pixel, the background, all four layers, the whitecaps and the deepening are
+   * computed in registers, and the pixel is written once. Each layer's angles are stepped incrementally along the strip,
+   * and palette lookups hit the PROGMEM LUTs instead of blending palette entries.
+   * Output is bit-identical to the original multi-pass renderer (fill, 4x pacifica_one_layer, whitecaps, deepen), since
+   * every step only ever depended on the same pixel's earlier steps.
+   */
+  void render(CRGB* iLEDs, uint16_t iNumLEDs)
+  {
+    uint16_t ci1 = _ciStart1, ci2 = _ciStart2, ci3 = _ciStart3, ci4 = _ciStart4;
+    uint16_t angle1 = _ioff1, angle2 = _ioff2, angle3 = _ioff3, angle4 = _ioff4;
+    uint16_t waveScaleHalf1 = (_waveScale1 / 2) + 20;
+    uint16_t waveScaleHalf2 = (_waveScale2 / 2) + 20;
+    const uint16_t waveScaleHalf3 = (6 * 256 / 2) + 20;
+    const uint16_t waveScaleHalf4 = (5 * 256 / 2) + 20;
+    uint8_t wave = _whitecapWave;
+
+    for (uint16_t i = 0; i < iNumLEDs; ++i)
+    {
+      // dim background blue-green, and the four layers of waves on top
+      CRGB c(2, 6, 10);
+      c += pacificaLayerStep(angle1, ci1, waveScaleHalf1, &pacificaLUT1, _bri1);
+      c += pacificaLayerStep(angle2, ci2, waveScaleHalf2, &pacificaLUT2, _bri2);
+      c += pacificaLayerStep(angle3, ci3, waveScaleHalf3, &pacificaLUT3, _bri3);
+      c += pacificaLayerStep(angle4, ci4, waveScaleHalf4, &pacificaLUT3, _bri4);
+
+      // brighter 'whitecaps' where the waves line up more
+      uint8_t threshold = scale8( sin8( wave), 20) + _whitecapThreshold;
+      wave += 7;
+      uint8_t l = c.getAverageLight();
+      if (l > threshold)
+      {
+        uint8_t overage = l - threshold;
+        uint8_t overage2 = qadd8( overage, overage);
+        c += CRGB( overage, overage2, qadd8( overage2, overage2));
+      }
+
+      // deepen the blues and greens a bit
+      c.blue = scale8( c.blue, 145);
+      c.green = scale8( c.green, 200);
+      c |= CRGB( 2, 5, 7);
+
+      iLEDs[i] = c;
+    }
+  }
+
+#ifdef MW_BENCHMARK
+  // Render the current frame with the original multi-pass renderer
+  void renderReference(CRGB* iLEDs, uint16_t iNumLEDs)
+  {
+    static const CRGBPalette16 palette1(pacifica_palette_1), palette2(pacifica_palette_2), palette3(pacifica_palette_3);
+
+    fill_solid(iLEDs, iNumLEDs, CRGB( 2, 6, 10));
+    pacifica_one_layer(iLEDs, iNumLEDs, palette1, _ciStart1, _waveScale1, _bri1, _ioff1);
+    pacifica_one_layer(iLEDs, iNumLEDs, palette2, _ciStart2, _waveScale2, _bri2, _ioff2);
+    pacifica_one_layer(iLEDs, iNumLEDs, palette3, _ciStart3, 6 * 256, _bri3, _ioff3);
+    pacifica_one_layer(iLEDs, iNumLEDs, palette3, _ciStart4, 5 * 256, _bri4, _ioff4);
+    pacifica_add_whitecaps(iLEDs, iNumLEDs, _whitecapThreshold, _whitecapWave);
+    pacifica_deepen_colors(iLEDs, iNumLEDs);
+  }
+#endif
+};
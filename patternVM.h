@@ -0,0 +1,483 @@
+#pragma once
+
+#include <EEPROM.h>
+#include <FastLED.h>
+#include <util/crc16.h>
+
+#include "clock.h"
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Bytecode VM for pattern programs, so new looks for LED strips don't need new per-pixel C code, nor a reflash.
+//
+// A program is a sequence of instructions, each an opcode byte followed by its operands, as listed in PATTERN_OPS:
+//  - r: register, 0 to PATTERN_VM_REGISTERS - 1
+//  - i: immediate byte
+//  - o: signed jump offset, relative to the next instruction
+// Every frame, the program runs once from the start, with r0 to r3 preset to the light's hue, saturation, max brightness
+// and a frame counter; r4 and up keep their values from frame to frame, and start at 0. Register arithmetic wraps around.
+// Scalar ops are generators (sin, beat, time, ...); draw ops render a range of the light's buffer with a native kernel.
+// Ranges are given as start and end positions along the strip, inclusive, from 0 to 255 whatever the strip length.
+//
+// Each op has an estimated cost in cycles, plus a cost per pixel for draw ops. A frame stops at the first op that would
+// exceed MW_PATTERN_CYCLE_BUDGET, so a runaway program can't stall the other lights. tools/pattern_asm.py assembles
+// programs, and uses the same costs to reject ahead of time the ones that can't run in budget on a given strip length.
+//
+// Programs are either built in (PROGMEM, below), or uploaded to one of MW_PATTERN_EEPROM_SLOTS slots in EEPROM through
+// SERIAL_CMD_WRITE_PROGRAM. Either way, they're selected as patterns after Pacifica, see PatternLightLEDStrip.
+// ----------------------------------------------------------------
+#define PATTERN_VM_REGISTERS 8
+#define PATTERN_VM_MAX_OPERANDS 6
+
+//                  name          operands  cycles  cycles/pixel
+#define PATTERN_OPS(X) \
+  X(OP_END,         "",         8,      0)   /* end of program */ \
+  X(OP_LDI,         "ri",       12,     0)   /* rd = imm */ \
+  X(OP_MOV,         "rr",       12,     0)   /* rd = rs */ \
+  X(OP_ADD,         "rr",       14,     0)   /* rd += rs */ \
+  X(OP_ADDI,        "ri",       14,     0)   /* rd += imm */ \
+  X(OP_SUB,         "rr",       14,     0)   /* rd -= rs */ \
+  X(OP_SCALE,       "rr",       24,     0)   /* rd = scale8(rd, rs) */ \
+  X(OP_SIN,         "rr",       40,     0)   /* rd = sin8(rs) */ \
+  X(OP_BEAT,        "ri",       90,     0)   /* rd = beat8(bpm) */ \
+  X(OP_BEATSIN,     "riii",     140,    0)   /* rd = beatsin8(bpm, low, high) */ \
+  X(OP_TIME,        "ri",       40,     0)   /* rd = clockMillis() >> shift */ \
+  X(OP_RANDOM,      "r",        30,     0)   /* rd = random8() */ \
+  X(OP_DJNZ,        "ro",       16,     0)   /* if (--rd) jump */ \
+  X(OP_FILL,        "rrrrr",    120,    12)  /* start, end, hue, saturation, value */ \
+  X(OP_GRADIENT,    "rrrrrr",   140,    110) /* start, end, hue, hue span, saturation, value */ \
+  X(OP_CHASE,       "rrrrr",    140,    120) /* head position, length in pixels, hue, saturation, value; tail fades out behind the head */ \
+  X(OP_PALETTE,     "rrrrrr",   140,    150) /* start, end, palette, first index, index step, value */ \
+  X(OP_FADE,        "r",        60,     20)  /* fade the whole strip to black by amount */
+
+enum PatternOp : byte
+{
+#define PATTERN_OP_ID(name, operands, cycles, pixelCycles) name,
+  PATTERN_OPS(PATTERN_OP_ID)
+#undef PATTERN_OP_ID
+  PATTERN_OP_COUNT
+};
+
+constexpr byte patternOperandCount(const char* s) { return *s ? 1 + patternOperandCount(s + 1) : 0; }
+
+// bit N is set if operand N is of kind c
+constexpr byte patternOperandMask(const char* s, char c, byte iBit = 0) { return *s ? ((*s == c) << iBit) | patternOperandMask(s + 1, c, iBit + 1) : 0; }
+
+struct PatternOpInfo
+{
+  byte operands;
+  byte registers; // mask of register operands
+  byte offsets;   // mask of jump offset operands
+  uint8_t cycles;
+  uint8_t pixelCycles;
+};
+
+const PatternOpInfo patternOps[PATTERN_OP_COUNT] PROGMEM = {
+#define PATTERN_OP_INFO(name, operands, cycles, pixelCycles) {patternOperandCount(operands), patternOperandMask(operands, 'r'), patternOperandMask(operands, 'o'), cycles, pixelCycles},
+  PATTERN_OPS(PATTERN_OP_INFO)
+#undef PATTERN_OP_INFO
+};
+
+// palettes for OP_PALETTE, by index
+const TProgmemRGBPalette16* const patternPalettes[] PROGMEM = {
+  &RainbowColors_p, &OceanColors_p, &LavaColors_p, &ForestColors_p, &PartyColors_p, &HeatColors_p, &CloudColors_p
+};
+
+static const byte NUM_PATTERN_PALETTES = sizeof(patternPalettes) / sizeof(patternPalettes[0]);
+
+// ----------------------------------------------------------------
+// Built in programs
+// ----------------------------------------------------------------
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+#define R4 4
+#define R5 5
+#define R6 6
+#define R7 7
+
+const byte patternProgramRainbow[] PROGMEM = { // full rainbow along the strip, slowly rotating
+  OP_LDI, R5, 0,
+  OP_LDI, R6, 255,
+  OP_BEAT, R4, 10,
+  OP_GRADIENT, R5, R6, R4, R6, R6, R2,
+  OP_END
+};
+
+const byte patternProgramComet[] PROGMEM = { // a comet in the light's color, running along the strip
+  OP_LDI, R5, 0,
+  OP_LDI, R6, 255,
+  OP_FILL, R5, R6, R5, R5, R5,
+  OP_BEAT, R4, 20,
+  OP_LDI, R7, 12,
+  OP_CHASE, R4, R7, R0, R1, R2,
+  OP_END
+};
+
+const byte patternProgramLava[] PROGMEM = { // lava palette, drifting along the strip
+  OP_LDI, R5, 0,
+  OP_LDI, R6, 255,
+  OP_LDI, R7, 2,
+  OP_BEAT, R4, 6,
+  OP_LDI, R3, 3,
+  OP_PALETTE, R5, R6, R7, R4, R3, R2,
+  OP_END
+};
+
+const byte patternProgramBreathe[] PROGMEM = { // the light's color, slowly breathing
+  OP_LDI, R5, 0,
+  OP_LDI, R6, 255,
+  OP_BEATSIN, R2, 12, 40, 255,
+  OP_FILL, R5, R6, R0, R1, R2,
+  OP_END
+};
+
+struct BuiltinPatternProgram
+{
+  const byte* code; // PROGMEM
+  byte length;
+};
+
+const BuiltinPatternProgram builtinPatternPrograms[] PROGMEM = {
+  {patternProgramRainbow, sizeof(patternProgramRainbow)},
+  {patternProgramComet, sizeof(patternProgramComet)},
+  {patternProgramLava, sizeof(patternProgramLava)},
+  {patternProgramBreathe, sizeof(patternProgramBreathe)},
+};
+
+#undef R0
+#undef R1
+#undef R2
+#undef R3
+#undef R4
+#undef R5
+#undef R6
+#undef R7
+
+static const byte NUM_BUILTIN_PATTERN_PROGRAMS = sizeof(builtinPatternPrograms) / sizeof(builtinPatternPrograms[0]);
+static const byte NUM_PATTERN_PROGRAMS = NUM_BUILTIN_PATTERN_PROGRAMS + MW_PATTERN_EEPROM_SLOTS;
+
+// ----------------------------------------------------------------
+// Program storage
+// EEPROM slots hold the program length, a CRC16 of the program (little endian), then the program itself.
+// ----------------------------------------------------------------
+#define PATTERN_EEPROM_SLOT_HEADER 3
+#define PATTERN_EEPROM_SLOT_SIZE (PATTERN_EEPROM_SLOT_HEADER + MW_PATTERN_PROGRAM_SIZE)
+#define PATTERN_EEPROM_SIZE (MW_PATTERN_EEPROM_SLOTS * PATTERN_EEPROM_SLOT_SIZE)
+
+static_assert(MW_PATTERN_EEPROM_ADDR + PATTERN_EEPROM_SIZE <= E2END + 1, "Pattern program slots don't fit in EEPROM");
+
+byte patternEEPROMGeneration = 0; // bumped whenever a slot is written, so lights reload their program
+
+enum PatternProgramSource : byte
+{
+  PATTERN_SOURCE_NONE, // empty or invalid slot; draws nothing
+  PATTERN_SOURCE_PROGMEM,
+  PATTERN_SOURCE_EEPROM,
+  PATTERN_SOURCE_RAM
+};
+
+struct PatternProgram
+{
+  PatternProgramSource source = PATTERN_SOURCE_NONE;
+  const byte* code = nullptr; // PROGMEM or RAM
+  int eepromAddr = 0;
+  byte length = 0;
+
+  byte operator[](byte iPC) const
+  {
+    switch (source)
+    {
+    case PATTERN_SOURCE_PROGMEM:
+      return pgm_read_byte(code + iPC);
+    case PATTERN_SOURCE_EEPROM:
+      return EEPROM.read(eepromAddr + iPC);
+    case PATTERN_SOURCE_RAM:
+      return code[iPC];
+    default:
+      return OP_END;
+    }
+  }
+};
+
+/**
+ * Check that a program only has known ops, valid registers, and jumps to the start of one of its own instructions,
+ * so the VM never has to.
+ */
+bool validatePatternProgram(const PatternProgram& iProgram)
+{
+  if (iProgram.length > MW_PATTERN_PROGRAM_SIZE)
+    return false;
+
+  // first pass: decode every instruction, and note where each one starts
+  byte starts[(MW_PATTERN_PROGRAM_SIZE + 7) / 8] = {};
+  byte pc = 0;
+  while (pc < iProgram.length)
+  {
+    byte op = iProgram[pc];
+    if (op >= PATTERN_OP_COUNT)
+      return false;
+    PatternOpInfo info;
+    memcpy_P(&info, patternOps + op, sizeof(info));
+    if (pc + 1 + info.operands > iProgram.length)
+      return false;
+
+    for (byte i = 0; i < info.operands; ++i)
+    {
+      if ((info.registers & (1 << i)) && iProgram[pc + 1 + i] >= PATTERN_VM_REGISTERS)
+        return false;
+    }
+    starts[pc >> 3] |= 1 << (pc & 7);
+    pc += 1 + info.operands;
+  }
+
+  // second pass: jumps may go forward, so they can only be checked once every instruction start is known
+  for (pc = 0; pc < iProgram.length;)
+  {
+    PatternOpInfo info;
+    memcpy_P(&info, patternOps + iProgram[pc], sizeof(info));
+    byte next = pc + 1 + info.operands;
+    for (byte i = 0; i < info.operands; ++i)
+    {
+      if (!(info.offsets & (1 << i)))
+        continue;
+      int target = next + (int8_t)iProgram[pc + 1 + i];
+      if (target < 0 || target >= iProgram.length || !(starts[target >> 3] & (1 << (target & 7))))
+        return false;
+    }
+    pc = next;
+  }
+  return true;
+}
+
+uint16_t patternCRC(const PatternProgram& iProgram)
+{
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < iProgram.length; ++i)
+    crc = _crc16_update(crc, iProgram[i]);
+  return crc;
+}
+
+int patternSlotAddress(byte iSlot) { return MW_PATTERN_EEPROM_ADDR + iSlot * PATTERN_EEPROM_SLOT_SIZE; }
+
+/**
+ * Program iIndex: built in programs first, then EEPROM slots. An empty or corrupt slot gives a PATTERN_SOURCE_NONE program.
+ */
+PatternProgram patternProgram(byte iIndex)
+{
+  PatternProgram program;
+  if (iIndex < NUM_BUILTIN_PATTERN_PROGRAMS)
+  {
+    program.source = PATTERN_SOURCE_PROGMEM;
+    program.code = (const byte*)pgm_read_ptr(&builtinPatternPrograms[iIndex].code);
+    program.length = pgm_read_byte(&builtinPatternPrograms[iIndex].length);
+    return program;
+  }
+
+  if (iIndex >= NUM_PATTERN_PROGRAMS)
+    return program;
+
+  int addr = patternSlotAddress(iIndex - NUM_BUILTIN_PATTERN_PROGRAMS);
+  program.source = PATTERN_SOURCE_EEPROM;
+  program.eepromAddr = addr + PATTERN_EEPROM_SLOT_HEADER;
+  program.length = EEPROM.read(addr);
+  uint16_t crc = EEPROM.read(addr + 1) | (EEPROM.read(addr + 2) << 8);
+  if (program.length > MW_PATTERN_PROGRAM_SIZE || patternCRC(program) != crc || !validatePatternProgram(program))
+    return PatternProgram();
+  return program;
+}
+
+/**
+ * Store a program in EEPROM slot iSlot. Returns false, and leaves the slot alone, if the program isn't valid.
+ */
+bool writePatternProgram(byte iSlot, const byte* iCode, byte iLength)
+{
+  PatternProgram program;
+  program.source = PATTERN_SOURCE_RAM;
+  program.code = iCode;
+  program.length = iLength;
+  if (iSlot >= MW_PATTERN_EEPROM_SLOTS || iLength > MW_PATTERN_PROGRAM_SIZE || !validatePatternProgram(program))
+    return false;
+
+  int addr = patternSlotAddress(iSlot);
+  uint16_t crc = patternCRC(program);
+  EEPROM.update(addr, iLength);
+  EEPROM.update(addr + 1, lowByte(crc));
+  EEPROM.update(addr + 2, highByte(crc));
+  for (byte i = 0; i < iLength; ++i)
+    EEPROM.update(addr + PATTERN_EEPROM_SLOT_HEADER + i, iCode[i]);
+
+  ++patternEEPROMGeneration;
+  return true;
+}
+
+// ----------------------------------------------------------------
+// VM
+// ----------------------------------------------------------------
+class PatternVM
+{
+  PatternProgram _program;
+  byte _regs[PATTERN_VM_REGISTERS];
+  byte _frame = 0;
+  byte _index = 0xFF;
+  byte _generation = 0;
+
+  // pixels [oFirst, oFirst + oCount) covered by positions iStart to iEnd, inclusive
+  static void range(byte iStart, byte iEnd, uint16_t iNumLEDs, uint16_t& oFirst, uint16_t& oCount)
+  {
+    oFirst = ((uint32_t)iStart * iNumLEDs) >> 8;
+    uint16_t last = (((uint32_t)iEnd + 1) * iNumLEDs) >> 8;
+    oCount = iStart <= iEnd && last > oFirst ? last - oFirst : 0;
+  }
+
+public:
+  /**
+   * Switch to program iIndex, if not already running it; registers start over from 0.
+   */
+  void select(byte iIndex)
+  {
+    if (iIndex == _index && _generation == patternEEPROMGeneration)
+      return;
+
+    _program = patternProgram(iIndex);
+    _index = iIndex;
+    _generation = patternEEPROMGeneration;
+    memset(_regs, 0, sizeof(_regs));
+    _frame = 0;
+  }
+
+  /**
+   * Run one frame of the selected program into ioLEDs.
+   * Returns false if the program was cut short by MW_PATTERN_CYCLE_BUDGET.
+   */
+  bool run(CRGB* ioLEDs, uint16_t iNumLEDs, byte iHue, byte iSaturation, byte iValue)
+  {
+    if (_program.source == PATTERN_SOURCE_NONE)
+    {
+      fill_solid(ioLEDs, iNumLEDs, CRGB::Black);
+      return true;
+    }
+
+    byte* r = _regs;
+    r[0] = iHue;
+    r[1] = iSaturation;
+    r[2] = iValue;
+    r[3] = _frame++;
+
+    uint32_t cycles = 0;
+    byte pc = 0;
+    while (pc < _program.length)
+    {
+      byte op = _program[pc];
+      if (op >= PATTERN_OP_COUNT)
+        break; // validated programs never get here; stop rather than read past patternOps
+      PatternOpInfo info;
+      memcpy_P(&info, patternOps + op, sizeof(info));
+
+      byte a[PATTERN_VM_MAX_OPERANDS];
+      for (byte i = 0; i < info.operands; ++i)
+        a[i] = _program[pc + 1 + i];
+      pc += 1 + info.operands;
+
+      // figure out how many pixels draw ops touch first, so they're only run if they fit in the budget
+      uint16_t first = 0, count = 0;
+      switch (op)
+      {
+      case OP_FILL:
+      case OP_GRADIENT:
+      case OP_PALETTE:
+        range(r[a[0]], r[a[1]], iNumLEDs, first, count);
+        break;
+      case OP_CHASE:
+        count = min((uint16_t)r[a[1]], iNumLEDs);
+        break;
+      case OP_FADE:
+        count = iNumLEDs;
+        break;
+      }
+      cycles += info.cycles + (uint32_t)info.pixelCycles * count;
+      if (cycles > MW_PATTERN_CYCLE_BUDGET)
+        return false;
+
+      switch (op)
+      {
+      case OP_END:
+        return true;
+      case OP_LDI:
+        r[a[0]] = a[1];
+        break;
+      case OP_MOV:
+        r[a[0]] = r[a[1]];
+        break;
+      case OP_ADD:
+        r[a[0]] += r[a[1]];
+        break;
+      case OP_ADDI:
+        r[a[0]] += a[1];
+        break;
+      case OP_SUB:
+        r[a[0]] -= r[a[1]];
+        break;
+      case OP_SCALE:
+        r[a[0]] = scale8(r[a[0]], r[a[1]]);
+        break;
+      case OP_SIN:
+        r[a[0]] = sin8(r[a[1]]);
+        break;
+      case OP_BEAT:
+        r[a[0]] = beat8(a[1]);
+        break;
+      case OP_BEATSIN:
+        r[a[0]] = beatsin8(a[1], a[2], a[3]);
+        break;
+      case OP_TIME:
+        r[a[0]] = clockMillis() >> (a[1] & 15);
+        break;
+      case OP_RANDOM:
+        r[a[0]] = random8();
+        break;
+      case OP_DJNZ:
+        if (--r[a[0]])
+          pc += (int8_t)a[1];
+        break;
+      case OP_FILL:
+        fill_solid(ioLEDs + first, count, CHSV(r[a[2]], r[a[3]], r[a[4]]));
+        break;
+      case OP_GRADIENT:
+      {
+        uint16_t hue = r[a[2]] << 8;
+        uint16_t step = count > 1 ? ((uint16_t)r[a[3]] << 8) / (count - 1) : 0;
+        for (uint16_t i = 0; i < count; ++i, hue += step)
+          ioLEDs[first + i] = CHSV(hue >> 8, r[a[4]], r[a[5]]);
+        break;
+      }
+      case OP_CHASE:
+      {
+        uint16_t head = ((uint32_t)r[a[0]] * iNumLEDs) >> 8;
+        uint16_t fade = count ? 255 / count : 0;
+        for (uint16_t i = 0; i < count; ++i)
+        {
+          uint16_t led = head >= i ? head - i : head + iNumLEDs - i;
+          ioLEDs[led] = CHSV(r[a[2]], r[a[3]], scale8(r[a[4]], 255 - i * fade));
+        }
+        break;
+      }
+      case OP_PALETTE:
+      {
+        if (r[a[2]] >= NUM_PATTERN_PALETTES)
+          break;
+        const TProgmemRGBPalette16& palette = *(const TProgmemRGBPalette16*)pgm_read_ptr(patternPalettes + r[a[2]]);
+        byte index = r[a[3]];
+        for (uint16_t i = 0; i < count; ++i, index += r[a[4]])
+          ioLEDs[first + i] = ColorFromPalette(palette, index, r[a[5]]);
+        break;
+      }
+      case OP_FADE:
+        fadeToBlackBy(ioLEDs, iNumLEDs, r[a[0]]);
+        break;
+      }
+    }
+    return true;
+  }
+};
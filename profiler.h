@@ -0,0 +1,280 @@
+#pragma once
+
+#include "clock.h"
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Per-stage frame profiler, measured on target.
+// Enable with MW_CYCLE_PROFILE in config.h; when disabled every PROFILE_* macro compiles out to nothing.
+//
+// Stages are: buttons, each light's update() by index, showing each LED controller by index (in the order lights
+// register them with FastLED; a light with several strips has several), RFID, serial control, and the whole frame
+// (renderFrame(), i.e. all the updates and shows). Each keeps min/avg/max and a log2 histogram of its duration in fixed
+// RAM, plus the breakdown of the worst frame seen; all of it is dumped on Serial every MW_PROFILE_REPORT_INTERVAL ms (if
+// not 0), or on demand through profileDump() (see SERIAL_CMD_PROFILE), then reset.
+// The scheduler starts the clock of a stage when it starts the stage's task (PROFILE_TASK_BEGIN()), so a stage only
+// measures its own task: neither the scheduler's idle passes nor the tasks it skipped are charged to it.
+// Tasks with no period run on every scheduler pass, i.e. tens of thousands of times between reports, so counts and
+// totals are 32 and 64-bit, and histogram buckets saturate at 65535 rather than 255. Should a count ever saturate (with
+// MW_PROFILE_REPORT_INTERVAL 0, after days), the stage's average stops being updated, rather than being corrupted.
+//
+// Timer1 is taken over as a free running counter at F_CPU/8, extended to 32 bits by its overflow interrupt.
+// Counts are therefore cycle accurate to 8 cycles, and survive FastLED.show() disabling interrupts for a whole
+// strip (a wrap takes 32ms, a 230 LED strip ~7ms), which micros() doesn't: it would lose Timer0 overflows, and report
+// the show stages short by exactly the time we're after. Timer1 only drives PWM on pins 11 and 12, which we don't use as outputs.
+//
+// With MW_SIMULATION, for runs in simavr (see sim/Makefile), there are no periodic dumps: the firmware runs for
+// MW_SIMULATION_MILLIS, dumps the profile of the whole run once, and halts.
+// ----------------------------------------------------------------
+#if defined(MW_SIMULATION) && !defined(MW_CYCLE_PROFILE)
+#error "MW_SIMULATION reports the cycle profile, define MW_CYCLE_PROFILE too"
+#endif
+
+#ifdef MW_CYCLE_PROFILE
+
+#include <avr/interrupt.h>
+#ifdef MW_SIMULATION
+#include <avr/sleep.h>
+#endif
+
+#define PROFILE_MAX_LIGHTS 6 // lights past this aren't profiled individually; their time goes to the next stage profiled
+#define PROFILE_MAX_CONTROLLERS 8 // same, for LED controllers
+#define PROFILE_HISTOGRAM_BUCKETS 12 // bucket 0 is < 16us, bucket N is [2^(N+3), 2^(N+4)) us, the last one is open ended
+
+enum ProfileStage : byte
+{
+  PROFILE_STAGE_BUTTONS = 0,
+  PROFILE_STAGE_UPDATES, // one stage per light, see PROFILE_STAGE_UPDATE()
+  PROFILE_STAGE_SHOWS = PROFILE_STAGE_UPDATES + PROFILE_MAX_LIGHTS, // one stage per LED controller, see PROFILE_STAGE_SHOW()
+  PROFILE_STAGE_RFID = PROFILE_STAGE_SHOWS + PROFILE_MAX_CONTROLLERS,
+  PROFILE_STAGE_SERIAL, // serial control protocol, see serialControl.h
+  PROFILE_STAGE_FRAME, // whole renderFrame(), see PROFILE_FRAME_BEGIN()
+  PROFILE_STAGE_COUNT,
+  PROFILE_STAGE_NONE = PROFILE_STAGE_COUNT // not profiled; time goes to the next stage marked
+};
+
+#define PROFILE_STAGE_UPDATE(i) ((i) < PROFILE_MAX_LIGHTS ? (ProfileStage)(PROFILE_STAGE_UPDATES + (i)) : PROFILE_STAGE_NONE)
+#define PROFILE_STAGE_SHOW(i) ((i) < PROFILE_MAX_CONTROLLERS ? (ProfileStage)(PROFILE_STAGE_SHOWS + (i)) : PROFILE_STAGE_NONE)
+
+volatile uint16_t profileTimerOverflows = 0;
+
+ISR(TIMER1_OVF_vect)
+{
+  ++profileTimerOverflows;
+}
+
+/**
+ * Current CPU cycle count, modulo 2^32 (~268s at 16MHz).
+ */
+uint32_t profileCycles()
+{
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t ticks = TCNT1;
+  uint16_t overflows = profileTimerOverflows;
+  if ((TIFR1 & _BV(TOV1)) && ticks < 0x8000) // overflow happened while we were reading, and hasn't been serviced yet
+    ++overflows;
+  SREG = oldSREG;
+
+  return (((uint32_t)overflows << 16) | ticks) << 3;
+}
+
+struct StageStats
+{
+  uint16_t minMicros;
+  uint16_t maxMicros;
+  uint64_t totalMicros;
+  uint32_t count; // saturates at UINT32_MAX, and so does totalMicros then
+  uint16_t histogram[PROFILE_HISTOGRAM_BUCKETS]; // saturates at UINT16_MAX
+};
+
+StageStats stageStats[PROFILE_STAGE_COUNT];
+uint16_t worstFrameMicros[PROFILE_STAGE_COUNT]; // breakdown of the slowest frame since the last dump
+uint16_t currentFrameMicros[PROFILE_STAGE_COUNT];
+uint32_t profileStageStart = 0;
+uint32_t profileFrameStart = 0;
+
+/**
+ * Whether a stage is part of a frame, and thus of the worst frame's breakdown.
+ */
+inline bool profileInFrame(byte iStage)
+{
+  return (iStage >= PROFILE_STAGE_UPDATES && iStage < PROFILE_STAGE_RFID) || iStage == PROFILE_STAGE_FRAME;
+}
+
+void profileReset()
+{
+  memset(stageStats, 0, sizeof(stageStats));
+  for (byte i = 0; i < PROFILE_STAGE_COUNT; ++i)
+    stageStats[i].minMicros = UINT16_MAX;
+  memset(worstFrameMicros, 0, sizeof(worstFrameMicros));
+}
+
+void profileSetup()
+{
+  TCCR1A = 0;
+  TCCR1B = _BV(CS11); // normal mode, clk/8
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  profileReset();
+}
+
+void profileRecord(ProfileStage iStage, uint32_t iCycles)
+{
+  uint32_t micros32 = iCycles / (F_CPU / 1000000);
+  uint16_t us = micros32 > UINT16_MAX ? UINT16_MAX : micros32;
+
+  StageStats& stats = stageStats[iStage];
+  if (us < stats.minMicros)
+    stats.minMicros = us;
+  if (us > stats.maxMicros)
+    stats.maxMicros = us;
+  if (stats.count < UINT32_MAX)
+  {
+    stats.totalMicros += us;
+    ++stats.count;
+  }
+
+  byte bucket = 0;
+  for (uint16_t v = us >> 4; v && bucket < PROFILE_HISTOGRAM_BUCKETS - 1; v >>= 1)
+    ++bucket;
+  if (stats.histogram[bucket] < UINT16_MAX)
+    ++stats.histogram[bucket];
+
+  currentFrameMicros[iStage] = us;
+}
+
+/**
+ * Start the clock of a task's stage; called by the scheduler, right before it runs the task.
+ */
+void profileTaskBegin()
+{
+  profileStageStart = profileCycles();
+}
+
+void profileFrameBegin()
+{
+  memset(currentFrameMicros, 0, sizeof(currentFrameMicros));
+  profileFrameStart = profileStageStart = profileCycles();
+}
+
+/**
+ * Close the current stage: everything since the previous mark (or the start of its task) is accounted to iStage.
+ */
+void profileMark(ProfileStage iStage)
+{
+  if (iStage == PROFILE_STAGE_NONE)
+    return;
+
+  uint32_t now = profileCycles();
+  profileRecord(iStage, now - profileStageStart);
+  profileStageStart = now;
+}
+
+void printStageName(byte iStage)
+{
+  if (iStage == PROFILE_STAGE_BUTTONS)
+    Serial.print(F("buttons"));
+  else if (iStage < PROFILE_STAGE_SHOWS)
+  {
+    Serial.print(F("update#")); Serial.print(iStage - PROFILE_STAGE_UPDATES);
+  }
+  else if (iStage < PROFILE_STAGE_RFID)
+  {
+    Serial.print(F("show#")); Serial.print(iStage - PROFILE_STAGE_SHOWS);
+  }
+  else if (iStage == PROFILE_STAGE_RFID)
+    Serial.print(F("rfid"));
+  else if (iStage == PROFILE_STAGE_SERIAL)
+    Serial.print(F("serial"));
+  else
+    Serial.print(F("frame"));
+}
+
+/**
+ * Print the stats of every stage that ran since the last dump, and start over.
+ */
+void profileDump()
+{
+  Serial.println(F("Profile (us): stage n min avg max worst-frame | histogram <16 <32 <64 ... >=16384"));
+  for (byte i = 0; i < PROFILE_STAGE_COUNT; ++i)
+  {
+    const StageStats& stats = stageStats[i];
+    if (!stats.count)
+      continue;
+
+    Serial.print(F("  ")); printStageName(i);
+    Serial.print(' '); Serial.print(stats.count);
+    Serial.print(' '); Serial.print(stats.minMicros);
+    Serial.print(' '); Serial.print((uint32_t)(stats.totalMicros / stats.count));
+    Serial.print(' '); Serial.print(stats.maxMicros);
+    Serial.print(' ');
+    if (profileInFrame(i))
+      Serial.print(worstFrameMicros[i]);
+    else
+      Serial.print('-');
+    Serial.print(F(" |"));
+    for (byte bucket = 0; bucket < PROFILE_HISTOGRAM_BUCKETS; ++bucket)
+    {
+      Serial.print(' '); Serial.print(stats.histogram[bucket]);
+    }
+    Serial.println();
+  }
+
+  profileReset();
+}
+
+#ifdef MW_SIMULATION
+/**
+ * Dump the profile of the whole run, and stop for good: sleeping with interrupts disabled ends a simavr run.
+ */
+void profileHalt()
+{
+  profileDump();
+  Serial.flush();
+  cli();
+  sleep_enable();
+  sleep_cpu();
+}
+#endif
+
+/**
+ * Close the frame, keep track of the worst one, and dump every MW_PROFILE_REPORT_INTERVAL; at the end of a simulation,
+ * dump and halt.
+ */
+void profileFrameEnd()
+{
+  profileRecord(PROFILE_STAGE_FRAME, profileCycles() - profileFrameStart);
+  if (currentFrameMicros[PROFILE_STAGE_FRAME] > worstFrameMicros[PROFILE_STAGE_FRAME])
+    memcpy(worstFrameMicros, currentFrameMicros, sizeof(worstFrameMicros));
+
+#if defined(MW_SIMULATION)
+  if (clockMillis() >= MW_SIMULATION_MILLIS)
+    profileHalt();
+#elif MW_PROFILE_REPORT_INTERVAL
+  static uint32_t prevReport = clockMillis();
+  uint32_t now = clockMillis();
+  if (now - prevReport >= MW_PROFILE_REPORT_INTERVAL)
+  {
+    profileDump();
+    prevReport = now;
+  }
+#endif
+}
+
+#define PROFILE_SETUP() profileSetup()
+#define PROFILE_TASK_BEGIN() profileTaskBegin()
+#define PROFILE_FRAME_BEGIN() profileFrameBegin()
+#define PROFILE_MARK(stage) profileMark(stage)
+#define PROFILE_FRAME_END() profileFrameEnd()
+
+#else
+
+#define PROFILE_SETUP()
+#define PROFILE_TASK_BEGIN()
+#define PROFILE_FRAME_BEGIN()
+#define PROFILE_MARK(stage)
+#define PROFILE_FRAME_END()
+
+#endif // MW_CYCLE_PROFILE
@@ -2,68 +2,279 @@
 
 #include <FastLED.h>
 
+#include "clock.h"
+#include "compileTime.h"
+
 #define FTIME 100
 
 // Quake style strobe lights, with added support for optional smoothing.
 // lowercase characters mean no smoothing; uppercase adds additional smoothing.
 // A given step being lowercase means no smoothing is applied when going towards it; smoothing may still applied while going away from it, if the step after that is uppercase.
-String lightstyles[] = {
-    "a",                                     // OFF
-    "z",                                     // ON
-    "HIJKLMNOPQRSTUVWXYZYXWVUTSRQPONMLKJIH", // PULSE
-    "MMNMMOMMOMMNONMMONQNMMO",               // FLICKER
-    "aaaaaaaazzzzzzzz",                      // SLOW STROBE
-    "zzazazzzzazzazazaaazazzza",             // FLUORESCENT FLICKER
+//
+// The strings are only used at compile time: each one is turned into a PROGMEM table of pre-scaled 0-255 levels, plus a
+// bitmap of which steps are smoothed (see CompiledLightstyle below), so nothing about them lives in SRAM or gets parsed at runtime.
+constexpr char LIGHTSTYLE_OFF[] = "a";
+constexpr char LIGHTSTYLE_ON[] = "z";
+constexpr char LIGHTSTYLE_PULSE[] = "HIJKLMNOPQRSTUVWXYZYXWVUTSRQPONMLKJIH";
+constexpr char LIGHTSTYLE_FLICKER[] = "MMNMMOMMOMMNONMMONQNMMO";
+constexpr char LIGHTSTYLE_SLOW_STROBE[] = "aaaaaaaazzzzzzzz";
+constexpr char LIGHTSTYLE_FLUORESCENT_FLICKER[] = "zzazazzzzazzazazaaazazzza";
+
+constexpr uint8_t lightstyleLength(const char* s) { return *s ? 1 + lightstyleLength(s + 1) : 0; }
+
+// 'a' to 'z' (either case) maps to 0 to 255, exactly like map(c - 'a', 0, 25, 0, 255) would
+constexpr uint8_t lightstyleLevel(char c) { return ((c < 'a' ? c + 32 : c) - 'a') * 255 / 25; }
+
+// bit N of byte iByte is set if step iByte * 8 + N is uppercase, i.e. smoothed
+constexpr uint8_t lightstyleSmoothing(const char* s, uint8_t iByte, uint8_t iBit = 0)
+{
+  return (iBit == 8 || !s[iByte * 8 + iBit]) ? 0 : (((s[iByte * 8 + iBit] < 'a') << iBit) | lightstyleSmoothing(s, iByte, iBit + 1));
+}
+
+template <const char* S,
+          typename Steps = typename MakeIndexSequence<lightstyleLength(S)>::type,
+          typename SmoothingBytes = typename MakeIndexSequence<(lightstyleLength(S) + 7) / 8>::type>
+struct CompiledLightstyle;
+
+template <const char* S, uint8_t... Steps, uint8_t... SmoothingBytes>
+struct CompiledLightstyle<S, IndexSequence<Steps...>, IndexSequence<SmoothingBytes...>>
+{
+  static const uint8_t levels[sizeof...(Steps)];
+  static const uint8_t smoothing[sizeof...(SmoothingBytes)];
+};
+
+template <const char* S, uint8_t... Steps, uint8_t... SmoothingBytes>
+const uint8_t CompiledLightstyle<S, IndexSequence<Steps...>, IndexSequence<SmoothingBytes...>>::levels[sizeof...(Steps)] PROGMEM = {lightstyleLevel(S[Steps])...};
+
+template <const char* S, uint8_t... Steps, uint8_t... SmoothingBytes>
+const uint8_t CompiledLightstyle<S, IndexSequence<Steps...>, IndexSequence<SmoothingBytes...>>::smoothing[sizeof...(SmoothingBytes)] PROGMEM = {lightstyleSmoothing(S, SmoothingBytes)...};
+
+struct Lightstyle
+{
+  const uint8_t* levels;    // PROGMEM
+  const uint8_t* smoothing; // PROGMEM
+  uint8_t length;
+};
+
+#define LIGHTSTYLE(s) { CompiledLightstyle<s>::levels, CompiledLightstyle<s>::smoothing, lightstyleLength(s) }
+
+const Lightstyle lightstyles[] PROGMEM = {
+    LIGHTSTYLE(LIGHTSTYLE_OFF),
+    LIGHTSTYLE(LIGHTSTYLE_ON),
+    LIGHTSTYLE(LIGHTSTYLE_PULSE),
+    LIGHTSTYLE(LIGHTSTYLE_FLICKER),
+    LIGHTSTYLE(LIGHTSTYLE_SLOW_STROBE),
+    LIGHTSTYLE(LIGHTSTYLE_FLUORESCENT_FLICKER),
 };
 
-static const byte NUM_LIGHTSTYLES = 6; // Keep this in sync with the size of the array above!
+static const byte NUM_LIGHTSTYLES = sizeof(lightstyles) / sizeof(lightstyles[0]);
+
+// elapsed * 255 / FTIME, without the divide: (elapsed * LIGHTSTYLE_LERP_RECIPROCAL) >> LIGHTSTYLE_LERP_SHIFT
+#define LIGHTSTYLE_LERP_SHIFT 11
+static const uint16_t LIGHTSTYLE_LERP_RECIPROCAL = ((255UL << LIGHTSTYLE_LERP_SHIFT) + FTIME - 1) / FTIME;
+
+constexpr bool lightstyleLerpIsExact(uint8_t elapsed)
+{
+  return (((uint32_t)elapsed * LIGHTSTYLE_LERP_RECIPROCAL) >> LIGHTSTYLE_LERP_SHIFT) == elapsed * 255 / FTIME && (elapsed == 0 || lightstyleLerpIsExact(elapsed - 1));
+}
+static_assert(FTIME < 256 && lightstyleLerpIsExact(FTIME - 1), "LIGHTSTYLE_LERP_RECIPROCAL doesn't reproduce elapsed * 255 / FTIME; adjust LIGHTSTYLE_LERP_SHIFT for this FTIME");
+
+const uint8_t lightstyleBitMasks[8] PROGMEM = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80}; // no barrel shifter on AVR
 
 /**
  * Calculate the next light value in a Quake style light animation
- * ioPrev: previous millis() on last run; provide as input, set to current run time on exit - NB: should we take an elapsed time instead?
+ * ioPrev: previous clockMillis() on last run; provide as input, set to current run time on exit - NB: should we take an elapsed time instead?
  * iPatternID: the ID of the pattern to use, from the lightstyles array
  * ioPreviousPatternID: storage for previous pattern ID, so we can handle pattern changes correctly
  * ioPatternStep: where we were time wise in the pattern, and where we are on exit
- * 
+ *
  * Returns the next light value, and modifies ioPrev, ioPrevPatternID, and ioPatternStep. Applying it to something is left to the caller.
- * 
+ *
  * Remaining "side effects" and globals used:
  *  - FTIME, the time step of animations in the lightstyles array
  *  - lightstyles information
  */
-byte enhancedQuakeFlicker(uint16_t &ioPrev, byte iPatternID, byte &ioPrevPatternID, byte &ioPatternStep)
+byte enhancedQuakeFlicker(uint32_t &ioPrev, byte iPatternID, byte &ioPrevPatternID, byte &ioPatternStep)
 {
-  uint16_t now = millis();
-  uint8_t elapsed = (uint8_t)(now - ioPrev);
+  uint32_t now = clockMillis();
+  uint32_t elapsed = now - ioPrev;
 
   if (ioPrevPatternID != iPatternID)
     ioPatternStep = 0;
   ioPrevPatternID = iPatternID; // safe to do unconditionally, NOOP if unchanged
 
-  byte lightChar = (lightstyles[iPatternID][ioPatternStep]);
-  byte nextLightChar = lightstyles[iPatternID][(ioPatternStep + 1) % lightstyles[iPatternID].length()];
+  Lightstyle style;
+  memcpy_P(&style, &lightstyles[iPatternID], sizeof(style));
 
-  // the "destination" step is what controls whether or not smoothing is applied
-  bool smoothing = nextLightChar < 97; // ASCII: A-Z is 65-90, a-z is 97-122
-
-  // remap uppercase to lowercase
-  lightChar = lightChar < 97 ? lightChar + 32 : lightChar;
-  nextLightChar = nextLightChar < 97 ? nextLightChar + 32 : nextLightChar;
+  byte nextStep = ioPatternStep + 1;
+  if (nextStep == style.length)
+    nextStep = 0;
 
-  // calculate "current" light value and next one in pattern
-  byte value = lightChar - 'a';
-  value = map(value, 0, 25, 0, 255);
-  byte nextValue = nextLightChar - 'a'; // get the value in the next step of the pattern, without incrementing the current pattern step
-  nextValue = map(nextValue, 0, 25, 0, 255);
-
-  // lerp, if appropriate, and set all LED pixels
-  byte lerpVal = smoothing ? lerp8by8(value, nextValue, elapsed >= FTIME ? 255 : (elapsed * 255 / FTIME)) : value; // this is probably a stupid way to scale elapsed to 0-255, representing 0-100% of FTIME, with appropriate clamping to 100%, but who cares
+  // calculate "current" light value, and lerp towards the next one if appropriate
+  // the "destination" step is what controls whether or not smoothing is applied
+  byte lerpVal = pgm_read_byte(style.levels + ioPatternStep);
+  if (pgm_read_byte(style.smoothing + (nextStep >> 3)) & pgm_read_byte(lightstyleBitMasks + (nextStep & 7)))
+  {
+    byte fraction = elapsed >= FTIME ? 255 : (((uint32_t)elapsed * LIGHTSTYLE_LERP_RECIPROCAL) >> LIGHTSTYLE_LERP_SHIFT); // 0-255, representing 0-100% of FTIME, clamped to 100%
+    lerpVal = lerp8by8(lerpVal, pgm_read_byte(style.levels + nextStep), fraction);
+  }
 
   if (elapsed >= FTIME)
   {
-    ioPatternStep = ++ioPatternStep % lightstyles[iPatternID].length();
+    ioPatternStep = nextStep;
     ioPrev = now;
   }
 
   return lerpVal;
-}
\ No newline at end of file
+}
+
+// ----------------------------------------------------------------
+// Spatial Quake styles
+// The same lightstyles, but with each pixel at its own point of the animation instead of the whole light in lockstep:
+//  - SPATIAL_CHASE: every pixel lags its neighbour by phaseStep (in 1/256 of a step), so the style runs along the strip,
+//    towards its end if phaseStep is positive, towards its start otherwise. 256 / |phaseStep| pixels per step.
+//  - SPATIAL_SCATTER: the strip is cut into cells of `pixels` pixels, each at an unrelated point of the style, so they
+//    all flicker on their own.
+//
+// Positions in a style are 8.8 fixed point: step, then 1/256 of a step. renderSpatialLightstyle() walks them along the
+// strip with an add per pixel (or per cell), only reading the style table when a pixel crosses into another step, so a
+// frame costs little more than filling the strip with a solid color.
+// ----------------------------------------------------------------
+enum SpatialLightstyleMode : uint8_t
+{
+  SPATIAL_CHASE,
+  SPATIAL_SCATTER
+};
+
+struct SpatialLightstyle
+{
+  Lightstyle style;
+  uint8_t mode;
+  int16_t phaseStep; // SPATIAL_CHASE only
+  uint8_t pixels;   // SPATIAL_SCATTER only
+};
+
+#define SPATIAL_CHASE_STYLE(s, phaseStep) { LIGHTSTYLE(s), SPATIAL_CHASE, phaseStep, 1 }
+#define SPATIAL_SCATTER_STYLE(s, pixels) { LIGHTSTYLE(s), SPATIAL_SCATTER, 0, pixels }
+
+const SpatialLightstyle spatialLightstyles[] PROGMEM = {
+    SPATIAL_CHASE_STYLE(LIGHTSTYLE_PULSE, 64),           // a slow wave, 4 pixels per step
+    SPATIAL_CHASE_STYLE(LIGHTSTYLE_PULSE, -64),          // same, running the other way
+    SPATIAL_CHASE_STYLE(LIGHTSTYLE_SLOW_STROBE, 128),    // marquee: blocks of 16 pixels on, 16 off
+    SPATIAL_SCATTER_STYLE(LIGHTSTYLE_FLICKER, 4),        // candles
+    SPATIAL_SCATTER_STYLE(LIGHTSTYLE_FLUORESCENT_FLICKER, 10), // a row of faulty tubes
+};
+
+static const byte NUM_SPATIAL_LIGHTSTYLES = sizeof(spatialLightstyles) / sizeof(spatialLightstyles[0]);
+
+/**
+ * Advance the clock of a spatial style.
+ * ioPrev: clockMillis() on last run; set to the current time on exit
+ * ioTime: where the style is, in ms since its first step; wraps around at its end
+ */
+void advanceSpatialLightstyle(uint32_t &ioPrev, uint16_t &ioTime, byte iSpatialID)
+{
+  uint32_t now = clockMillis();
+  uint8_t length = pgm_read_byte(&spatialLightstyles[iSpatialID].style.length);
+  ioTime = (ioTime + (now - ioPrev)) % (length * FTIME);
+  ioPrev = now;
+}
+
+/**
+ * Turns positions in a lightstyle into colors, caching the levels around the step last looked up, and the color of the
+ * last level, since neighbouring pixels mostly share both.
+ */
+class LightstyleCursor
+{
+  const Lightstyle &_style;
+  const CRGB &_color;
+  uint8_t _step = 0xFF;
+  uint8_t _from = 0;
+  uint8_t _to = 0;
+  bool _smoothed = false;
+  uint8_t _level = 0;
+  CRGB _scaled = CRGB::Black; // _color at _level
+
+public:
+  LightstyleCursor(const Lightstyle &iStyle, const CRGB &iColor) : _style(iStyle), _color(iColor) {}
+
+  const CRGB &colorAt(uint16_t iPhase)
+  {
+    uint8_t step = iPhase >> 8;
+    if (step != _step)
+    {
+      _step = step;
+      uint8_t nextStep = step + 1 == _style.length ? 0 : step + 1;
+      _from = pgm_read_byte(_style.levels + step);
+      _to = pgm_read_byte(_style.levels + nextStep);
+      _smoothed = pgm_read_byte(_style.smoothing + (nextStep >> 3)) & pgm_read_byte(lightstyleBitMasks + (nextStep & 7));
+    }
+
+    uint8_t level = _smoothed ? lerp8by8(_from, _to, iPhase & 0xFF) : _from;
+    if (level != _level)
+    {
+      _level = level;
+      _scaled = _color;
+      _scaled.nscale8_video(level);
+    }
+    return _scaled;
+  }
+};
+
+/**
+ * Render a spatial style into oLEDs, as of iTime (see advanceSpatialLightstyle()), with every pixel iColor scaled by its
+ * own level. The first pixel gets the level enhancedQuakeFlicker() would give the whole light, but not exactly the same
+ * color: the lockstep styles scale the value before converting to RGB, while this scales the RGB color, since converting
+ * every level a strip shows would cost an HSV to RGB conversion per pixel. The two may differ by rounding.
+ */
+void renderSpatialLightstyle(byte iSpatialID, uint16_t iTime, const CRGB &iColor, CRGB *oLEDs, uint16_t iNumLEDs)
+{
+  SpatialLightstyle spatial;
+  memcpy_P(&spatial, &spatialLightstyles[iSpatialID], sizeof(spatial));
+  const uint16_t end = spatial.style.length << 8;
+  LightstyleCursor cursor(spatial.style, iColor);
+
+  uint8_t step = iTime / FTIME;
+  uint8_t fraction = ((uint32_t)(iTime - step * FTIME) * LIGHTSTYLE_LERP_RECIPROCAL) >> LIGHTSTYLE_LERP_SHIFT; // as in enhancedQuakeFlicker()
+  uint16_t phase = (step << 8) | fraction;
+
+  if (spatial.mode == SPATIAL_CHASE)
+  {
+    uint16_t phaseStep = spatial.phaseStep < 0 ? -spatial.phaseStep : spatial.phaseStep;
+    for (uint16_t i = 0; i < iNumLEDs; ++i)
+    {
+      oLEDs[i] = cursor.colorAt(phase);
+      if (spatial.phaseStep > 0)
+      { // pixels further down the strip are behind, so the style runs towards the end
+        if (phase < phaseStep)
+          phase += end;
+        phase -= phaseStep;
+      }
+      else
+      {
+        phase += phaseStep;
+        if (phase >= end)
+          phase -= end;
+      }
+    }
+  }
+  else
+  {
+    // cells are offset from each other by ~0.618 of the style, i.e. the golden ratio, which keeps neighbours far apart
+    uint16_t offsetStep = ((uint32_t)end * 158) >> 8;
+    uint16_t offset = 0;
+    for (uint16_t i = 0; i < iNumLEDs; i += spatial.pixels)
+    {
+      uint16_t cellPhase = phase + offset;
+      if (cellPhase >= end)
+        cellPhase -= end;
+      const CRGB &cellColor = cursor.colorAt(cellPhase);
+      for (uint16_t j = i; j < i + spatial.pixels && j < iNumLEDs; ++j)
+        oLEDs[j] = cellColor;
+
+      offset += offsetStep;
+      if (offset >= end)
+        offset -= end;
+    }
+  }
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Record/replay harness.
+// Enable with MW_REPLAY in config.h: instead of running normally, setup() plays replayScript below on the virtual clock
+// from clock.h, calling loop() for every frame and printing a checksum of every light's output on Serial. Since the
+// clock only moves when the script says so, a given firmware prints the exact same log every time. host/replay.golden
+// is that log; check the log of any renderer change against it with tools/replay_diff.py (or make -C host replay-check)
+// to prove it didn't change a single pixel or frame timing.
+//
+// Log format, one line per frame:
+//   frame <n> t=<virtual ms>: <light 0 output crc>/<light 0 _val> <light 1 output crc>/<light 1 _val> ...
+// _val is the raw flicker value, which is also the PWM duty cycle for PWM lights (e.g. starfield).
+// ----------------------------------------------------------------
+#ifdef MW_REPLAY
+
+#include <util/crc16.h>
+
+#include "clock.h"
+#include "buttons.h"
+#include "tagFormat.h"
+#include "tagCache.h"
+
+// from MW3.ino, the steps checkRFID() takes when a tag is swiped
+void applyCachedTag(const MFRC522::Uid& iUid);
+void applyReadTag(const MFRC522::Uid& iUid, const byte* iBlocks, byte iNumBlocks);
+extern TagCache tagCache;
+
+enum ReplayOp : byte
+{
+  REPLAY_FRAMES, // arg: number of frames to run, value: virtual ms to advance before each frame
+  REPLAY_BUTTON, // arg: ReplayButton, value: AceButton event type
+  REPLAY_TAG,    // arg: index into replayTags; applied as if it had been read from a tag
+  REPLAY_SWIPE,  // arg: index into replayTags, value: last byte of the tag's UID; goes through the tag cache, like a real swipe
+  REPLAY_END
+};
+
+enum ReplayButton : byte
+{
+  REPLAY_BUTTON_ADMIN,
+  REPLAY_BUTTON_MODE,
+  REPLAY_BUTTON_COLOR,
+  REPLAY_BUTTON_RFID
+};
+
+struct ReplayEvent
+{
+  byte op;
+  byte arg;
+  uint16_t value;
+};
+
+// Tag contents, in the same layout as MW_RFID_DATA_BLOCK_ADDR on a real tag (one block is enough for our 5 lights, in either format)
+const byte replayTags[][16] PROGMEM = {
+  {0x09, 0x00, 0xFF, 0x0C, 0xA0, 0xFF, 0x00, 0x00, 0x00, 0x0B, 0x40, 0xC0, 0x04, 0x00, 0x00, 0xFF}, // cycling strobe windows, pacifica ground, cycling fluorescent moat, pulsing starfield
+  {0x0C, 0x60, 0xFF, 0x0C, 0x00, 0x00, 0x10, 0x00, 0x00, 0x0C, 0x00, 0x00, 0x0A, 0x00, 0x00, 0xFF}, // pacifica everywhere, fairy lights on, fluorescent starfield
+  {0x4D, 0x15, 0x05, 0xEA, 0x06, 0xF4, 0x10, 0x00, 0x0C, 0x00, 0x06, 0x00, 0x00, 0x00, 0x79, 0x5D}, // packed format: cycling pulse windows, flickering green ground, fairy lights on, pacifica moat, flickering starfield
+  {0x4D, 0x15, 0x05, 0xEA, 0x06, 0xF4, 0x10, 0x00, 0x0C, 0x00, 0x06, 0x00, 0x00, 0x00, 0x79, 0x5E}, // same, with a bad CRC: must be rejected without touching any light
+};
+
+// Exercises every pattern type, color cycling, pattern changes mid-animation, and tag scene changes
+const ReplayEvent replayScript[] PROGMEM = {
+  {REPLAY_FRAMES, 120, 17}, // ~2s of the default scene
+  {REPLAY_BUTTON, REPLAY_BUTTON_MODE, AceButton::kEventPressed},
+  {REPLAY_FRAMES, 60, 17},
+  {REPLAY_BUTTON, REPLAY_BUTTON_MODE, AceButton::kEventPressed},
+  {REPLAY_FRAMES, 60, 17},
+  {REPLAY_BUTTON, REPLAY_BUTTON_COLOR, AceButton::kEventClicked}, // start cycling colors
+  {REPLAY_FRAMES, 90, 16},
+  {REPLAY_BUTTON, REPLAY_BUTTON_COLOR, AceButton::kEventLongPressed}, // back to white
+  {REPLAY_FRAMES, 30, 16},
+  {REPLAY_TAG, 0, 0},
+  {REPLAY_FRAMES, 150, 20},
+  {REPLAY_FRAMES, 5, 300}, // long stalls, e.g. a slow tag write
+  {REPLAY_TAG, 1, 0},
+  {REPLAY_FRAMES, 150, 17},
+  {REPLAY_TAG, 2, 0},
+  {REPLAY_FRAMES, 90, 17},
+  {REPLAY_TAG, 3, 0},
+  {REPLAY_FRAMES, 30, 17},
+  {REPLAY_BUTTON, REPLAY_BUTTON_RFID, AceButton::kEventDoubleClicked}, // only arms the override, which checkRFID() would apply
+  {REPLAY_FRAMES, 30, 33},
+  {REPLAY_BUTTON, REPLAY_BUTTON_ADMIN, AceButton::kEventPressed}, // select the ground lights, and pulse them over their pattern
+  {REPLAY_FRAMES, 60, 17},
+  {REPLAY_SWIPE, 0, 1}, // an unknown tag: read, cached, then crossfaded to
+  {REPLAY_FRAMES, 45, 17},
+  {REPLAY_SWIPE, 1, 2},
+  {REPLAY_FRAMES, 45, 17},
+  {REPLAY_SWIPE, 0, 1}, // the same tag again: applied from the cache, and must crossfade just the same
+  {REPLAY_FRAMES, 45, 17},
+  {REPLAY_END, 0, 0}
+};
+
+
+MFRC522::Uid replayUid(byte iLastByte)
+{
+  MFRC522::Uid uid;
+  uid.size = 4;
+  uid.uidByte[0] = 'M';
+  uid.uidByte[1] = 'W';
+  uid.uidByte[2] = '3';
+  uid.uidByte[3] = iLastByte;
+  uid.sak = 0x08; // MIFARE Classic 1K
+  return uid;
+}
+
+/**
+ * Swipe a tag, as checkRFID() handles it: identified first, then read.
+ */
+void replaySwipe(byte iTag, byte iUidByte)
+{
+  byte block[16];
+  memcpy_P(block, replayTags[iTag], sizeof(block));
+  MFRC522::Uid uid = replayUid(iUidByte);
+  applyCachedTag(uid);
+  applyReadTag(uid, block, 1);
+}
+
+/**
+ * Forget the tags the script swipes, so the replay doesn't depend on what the cache in EEPROM held before.
+ */
+void forgetReplayTags()
+{
+  for (const ReplayEvent* event = replayScript; pgm_read_byte(&event->op) != REPLAY_END; ++event)
+  {
+    if (pgm_read_byte(&event->op) == REPLAY_SWIPE)
+      tagCache.remove(replayUid(pgm_read_word(&event->value)));
+  }
+}
+
+void replayButtonEvent(byte iButton, uint8_t iEventType)
+{
+  switch (iButton)
+  {
+  case REPLAY_BUTTON_ADMIN:
+    adminButtonEventHandler(&adminButton, iEventType, 0);
+    break;
+  case REPLAY_BUTTON_MODE:
+    modeButtonEventHandler(&modeButton, iEventType, 0);
+    break;
+  case REPLAY_BUTTON_COLOR:
+    colorButtonEventHandler(&colorButton, iEventType, 0);
+    break;
+  case REPLAY_BUTTON_RFID:
+    rfidButtonEventHandler(&rfidButton, iEventType, 0);
+    break;
+  }
+}
+
+// prints a light's checksum, and folds it into the checksum of the whole replay
+struct RecordLight
+{
+  uint16_t replayCRC;
+
+  template <typename L>
+  void operator()(L& iLight, byte iIndex)
+  {
+    uint16_t crc = iLight.outputChecksum(0xFFFF);
+    Serial.print(' '); Serial.print(crc, HEX); Serial.print('/'); Serial.print(iLight._val);
+
+    replayCRC = _crc16_update(replayCRC, crc & 0xFF);
+    replayCRC = _crc16_update(replayCRC, crc >> 8);
+    replayCRC = _crc16_update(replayCRC, iLight._val);
+  }
+};
+
+/**
+ * Print the checksum line for the frame that was just rendered, and fold it into the checksum of the whole replay.
+ * Lights: the LightRegistry of the lights to checksum, see lightRegistry.h.
+ */
+template <typename Lights>
+uint16_t recordReplayFrame(uint16_t iFrame, uint16_t iReplayCRC)
+{
+  Serial.print(F("frame ")); Serial.print(iFrame);
+  Serial.print(F(" t=")); Serial.print(clockMillis()); Serial.print(':');
+  RecordLight recordLight = {iReplayCRC};
+  Lights::forEach(recordLight);
+  Serial.println();
+
+  return recordLight.replayCRC;
+}
+
+template <typename Lights>
+void runReplay()
+{
+  uint16_t frame = 0;
+  uint16_t replayCRC = 0xFFFF;
+
+  forgetReplayTags();
+  Serial.println(F("Replay starting."));
+  for (const ReplayEvent* event = replayScript; ; ++event)
+  {
+    ReplayEvent e;
+    memcpy_P(&e, event, sizeof(e));
+
+    if (e.op == REPLAY_END)
+      break;
+
+    switch (e.op)
+    {
+    case REPLAY_FRAMES:
+      for (byte i = 0; i < e.arg; ++i)
+      {
+        advanceClock(e.value);
+        loop();
+        replayCRC = recordReplayFrame<Lights>(frame++, replayCRC);
+      }
+      break;
+    case REPLAY_BUTTON:
+      replayButtonEvent(e.arg, e.value);
+      break;
+    case REPLAY_TAG:
+      {
+        byte block[16];
+        memcpy_P(block, replayTags[e.arg], sizeof(block));
+        LightConfiguration config;
+        if (decodeTag(block, 1, lights, NUM_LIGHTOBJECTS, config))
+          applyLightConfiguration(config, lights, NUM_LIGHTOBJECTS);
+      }
+      break;
+    case REPLAY_SWIPE:
+      replaySwipe(e.arg, e.value);
+      break;
+    }
+  }
+
+  Serial.print(F("Replay done: ")); Serial.print(frame); Serial.print(F(" frames, crc=")); Serial.println(replayCRC, HEX);
+#ifdef MW_HOST
+  exit(0); // nothing left to run the host build for, see host/Makefile
+#else
+  while (true)
+    ;
+#endif
+}
+
+#endif // MW_REPLAY
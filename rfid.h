@@ -2,27 +2,19 @@
 
 #include <MFRC522.h>
 
-MFRC522::MIFARE_Key mifareDefaultKey = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+#include "log.h"
 
-void printHex(byte *buffer, byte bufferSize) {
-  Serial.print("{ ");
-  for (byte i = 0; i < bufferSize; i++) {
-    Serial.print("0x");
-    Serial.print(buffer[i] < 0x10 ? "0" : "");
-    Serial.print(buffer[i], HEX);
-    Serial.print((i == bufferSize-1) ? " }" : ", ");
-  }
-}
+MFRC522::MIFARE_Key mifareDefaultKey = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
 
 /**
- * Print some debugging info for a tag.
+ * Log some debugging info for a tag.
  * Note: the input reader object must have already called PICC_ReadCardSerial()
  */
-void printTagDebug(MFRC522& reader)
+void logTagDebug(MFRC522& reader)
 {
   MFRC522::PICC_Type piccType = reader.PICC_GetType(reader.uid.sak);
-  
-  Serial.print("Tag ID: "); printHex(reader.uid.uidByte, reader.uid.size); Serial.print(" - "); Serial.print(F("PICC type: ")); Serial.println(reader.PICC_GetTypeName(piccType));
+
+  logEvent(LOG_TAG_DETECTED, LogBytes{reader.uid.uidByte, reader.uid.size}, piccType);
 }
 
 bool checkCompatibleTag(MFRC522& reader)
@@ -31,53 +23,32 @@ bool checkCompatibleTag(MFRC522& reader)
 
   if (type != MFRC522::PICC_TYPE_MIFARE_MINI && type != MFRC522::PICC_TYPE_MIFARE_1K && type != MFRC522::PICC_TYPE_MIFARE_4K)
   {
-    Serial.println(F("Unsupported PICC type; please use MIFARE Classic tags."));
+    logEvent(LOG_TAG_UNSUPPORTED);
     return false;
   }
 
   return true;
 }
 
-MFRC522::StatusCode readBlock(MFRC522& reader, byte iBlockAddr, byte* oData, byte* ioSize) {
-  MFRC522::StatusCode status;
-  
-  byte trailerAddr = ((iBlockAddr / 4)*4)+3; // block address of the sector trailer for the block we're trying to read
-  
-  status = (MFRC522::StatusCode) reader.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, trailerAddr, &mifareDefaultKey, &(reader.uid));
-  if (status != MFRC522::STATUS_OK) {
-      return status;
-  }
-  
-  // Serial.print("Reading block #"); Serial.print(iBlockAddr); Serial.print(" - trailer address for read is: "); Serial.println(trailerAddr);
-  return (MFRC522::StatusCode) reader.MIFARE_Read(iBlockAddr, oData, ioSize);
-}
-
-MFRC522::StatusCode writeBlock(MFRC522& reader, byte iBlockAddr, byte* iData)
-{
-  MFRC522::StatusCode status;
-  
-  byte trailerAddr = ((iBlockAddr / 4)*4)+3; // block address of the sector trailer for the block we're trying to read
-  status = (MFRC522::StatusCode) reader.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, trailerAddr, &mifareDefaultKey, &(reader.uid));
-  if (status != MFRC522::STATUS_OK) {
-      return status;
-  }
+// block address of the sector trailer for the sector a block is in
+inline byte sectorTrailer(byte iBlockAddr) { return ((iBlockAddr / 4) * 4) + 3; }
 
-  // Serial.print("Writing block #"); Serial.println(iBlockAddr); Serial.print(" - railer address for write is: "); Serial.println(trailerAddr);
-  return reader.MIFARE_Write(iBlockAddr, iData, 16);
-};
-
-void dump_byte_array(byte *buffer, byte bufferSize)
+// true if none of the iCount blocks starting at iFirstBlockAddr is a sector trailer, which must never be read or written as data
+constexpr bool blocksAvoidTrailers(byte iFirstBlockAddr, byte iCount)
 {
-  for (byte i = 0; i < bufferSize; i++)
-  {
-    Serial.print(buffer[i] < 0x10 ? " 0" : " ");
-    Serial.print(buffer[i], HEX);
-  }
+  return iCount == 0 || ((iFirstBlockAddr % 4) != 3 && blocksAvoidTrailers(iFirstBlockAddr + 1, iCount - 1));
 }
 
+/**
+ * A session with one selected tag.
+ * Authenticates once per sector rather than once per block, and writes runs of blocks within that; reads are spread
+ * over several passes by TagReader instead (see tagReader.h).
+ * Halts the tag and stops crypto on destruction, regardless of errors.
+ */
 class ReaderSession
 {
   MFRC522& _reader;
+  byte _authenticatedTrailer = 0xFF; // sector trailer of the sector we're authenticated for, if any
 
 public:
   ReaderSession(MFRC522& reader) : _reader(reader) {};
@@ -85,4 +56,48 @@ public:
     _reader.PICC_HaltA();
     _reader.PCD_StopCrypto1();
   };
+
+  MFRC522::StatusCode authenticate(byte iBlockAddr)
+  {
+    byte trailerAddr = sectorTrailer(iBlockAddr);
+    if (trailerAddr == _authenticatedTrailer)
+      return MFRC522::STATUS_OK;
+
+    MFRC522::StatusCode status = _reader.PCD_Authenticate(MFRC522::PICC_CMD_MF_AUTH_KEY_A, trailerAddr, &mifareDefaultKey, &(_reader.uid));
+    _authenticatedTrailer = status == MFRC522::STATUS_OK ? trailerAddr : 0xFF;
+    return status;
+  }
+
+  /**
+   * Write iCount consecutive blocks from iData (16 bytes each), authenticating only when crossing into a new sector.
+   * iVerify: read every block back after writing it, and fail with STATUS_ERROR if it doesn't match
+   */
+  MFRC522::StatusCode writeBlocks(byte iFirstBlockAddr, byte iCount, const byte* iData, bool iVerify)
+  {
+    byte buffer[18];
+
+    for (byte i = 0; i < iCount; ++i)
+    {
+      MFRC522::StatusCode status = authenticate(iFirstBlockAddr + i);
+      if (status != MFRC522::STATUS_OK)
+        return status;
+
+      memcpy(buffer, iData + i * 16, 16);
+      status = _reader.MIFARE_Write(iFirstBlockAddr + i, buffer, 16);
+      if (status != MFRC522::STATUS_OK)
+        return status;
+
+      if (iVerify)
+      {
+        byte size = sizeof(buffer);
+        status = _reader.MIFARE_Read(iFirstBlockAddr + i, buffer, &size);
+        if (status != MFRC522::STATUS_OK)
+          return status;
+        if (memcmp(buffer, iData + i * 16, 16) != 0)
+          return MFRC522::STATUS_ERROR;
+      }
+    }
+
+    return MFRC522::STATUS_OK;
+  }
 };
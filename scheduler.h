@@ -0,0 +1,126 @@
+#pragma once
+
+#include "clock.h"
+#include "config.h"
+#include "log.h"
+#include "profiler.h"
+
+// ----------------------------------------------------------------
+// Cooperative task scheduler, run by loop().
+// Everything the firmware does periodically (buttons, rendering, RFID, serial) is a Task, with a period, a deadline and
+// a priority, instead of each keeping its own timestamps. Every pass reads the frame clock once (see clock.h), then runs
+// the tasks that are due, highest priority first.
+//
+// Tasks run to completion, so they must not block: a task that needs more time spreads its work over several runs.
+// Background tasks only start if the slack before the next higher priority task is due can fit their longest recent
+// run, so they fill the time between frames instead of pushing frames back; a background task deferred past its deadline
+// runs anyway, so it can't starve; that's expected whenever frames are busy, so it isn't logged. Higher priority tasks
+// that start more than their deadline late are logged (LOG_TASK_LATE).
+// A task that falls more than a period behind skips the runs it missed, rather than running back to back to catch up.
+// ----------------------------------------------------------------
+#define SCHEDULER_MAX_TASKS 8
+
+enum TaskPriority : byte
+{
+  TASK_PRIORITY_HIGH,      // e.g. rendering frames
+  TASK_PRIORITY_NORMAL,    // e.g. user input
+  TASK_PRIORITY_BACKGROUND // only run in the slack between higher priority tasks
+};
+
+struct Task
+{
+  void (*run)();
+  uint16_t period;   // ms between runs; 0 to run on every pass
+  uint16_t deadline; // ms a run may start late before it's logged (or for background tasks, forced); 0 for no deadline
+  TaskPriority priority;
+
+  uint32_t due;         // clockMillis() of the next run
+  uint16_t worstMicros; // longest recent run, slowly decaying
+
+  Task(void (*iRun)(), uint16_t iPeriod, uint16_t iDeadline, TaskPriority iPriority)
+      : run(iRun), period(iPeriod), deadline(iDeadline), priority(iPriority), due(0), worstMicros(0) {};
+};
+
+class Scheduler
+{
+  Task* _tasks;
+  byte _numTasks;
+  byte _order[SCHEDULER_MAX_TASKS]; // task indices, by priority
+
+  /**
+   * Whether a background task can run now, without delaying any higher priority task.
+   */
+  bool fits(const Task& iTask)
+  {
+#ifdef MW_REPLAY
+    return true; // depends on real time, which replays must not
+#else
+    int32_t slack = INT32_MAX;
+    for (byte i = 0; i < _numTasks; ++i)
+    {
+      const Task& other = _tasks[i];
+      if (other.priority < iTask.priority && other.period)
+        slack = min(slack, (int32_t)(other.due - clockMillis()) * 1000);
+    }
+    slack -= (int32_t)(micros() - clockMicros()); // what this pass already used up
+    return slack >= (int32_t)iTask.worstMicros;
+#endif
+  }
+
+public:
+  /**
+   * iTasks: iNumTasks tasks, in any order; tasks of the same priority run in the order given
+   */
+  Scheduler(Task* iTasks, byte iNumTasks) : _tasks(iTasks), _numTasks(min(iNumTasks, SCHEDULER_MAX_TASKS))
+  {
+    for (byte i = 0; i < _numTasks; ++i)
+    {
+      byte j = i;
+      for (; j > 0 && _tasks[_order[j - 1]].priority > _tasks[i].priority; --j)
+        _order[j] = _order[j - 1];
+      _order[j] = i;
+    }
+  };
+
+  /**
+   * Make every task due on the first pass.
+   */
+  void setup()
+  {
+    tickClock();
+    for (byte i = 0; i < _numTasks; ++i)
+      _tasks[i].due = clockMillis();
+  };
+
+  /**
+   * One scheduler pass: tick the frame clock, then run every task that is due. Call from loop().
+   */
+  void run()
+  {
+    tickClock();
+    uint32_t now = clockMillis();
+
+    for (byte i = 0; i < _numTasks; ++i)
+    {
+      Task& task = _tasks[_order[i]];
+      int32_t late = now - task.due;
+      if (late < 0)
+        continue;
+
+      bool overdue = task.deadline && late > task.deadline;
+      if (task.priority == TASK_PRIORITY_BACKGROUND && !overdue && !fits(task))
+        continue;
+      if (overdue && task.priority != TASK_PRIORITY_BACKGROUND)
+        logEvent(LOG_TASK_LATE, _order[i], (uint16_t)min(late, (int32_t)UINT16_MAX));
+
+      uint32_t start = micros();
+      PROFILE_TASK_BEGIN();
+      task.run();
+      uint32_t elapsed = micros() - start;
+      uint16_t decayed = task.worstMicros - (task.worstMicros >> 4);
+      task.worstMicros = elapsed > decayed ? (uint16_t)min(elapsed, (uint32_t)UINT16_MAX) : decayed;
+
+      task.due = late >= (int32_t)task.period ? now + task.period : task.due + task.period;
+    }
+  };
+};
@@ -0,0 +1,307 @@
+#pragma once
+
+#include "config.h"
+#include "lights.h"
+#include "tagFormat.h"
+#include "profiler.h"
+
+// ----------------------------------------------------------------
+// Binary control protocol on Serial, so a host can program the lights live instead of going through the buttons.
+//
+// Frames are COBS encoded, and delimited by a 0x00 byte on both ends. Anything that doesn't decode into a valid frame
+// (including the plain text we print on Serial) is dropped, so both sides can resync on the next delimiter.
+// Decoded, a frame is:
+//  - byte 0: sequence number, echoed back in the reply; never 0xFF, which marks log frames (see log.h)
+//  - byte 1: command (requests) or status (replies)
+//  - arguments
+//  - CRC16 of everything before it (same as tag data, see tagCRC()), little endian
+//
+// Commands and their arguments:
+//  - SERIAL_CMD_SET_LIGHT: light index, field mask (SERIAL_FIELD_*), patternID, cycleColor, hue, saturation;
+//    only the fields in the mask are changed
+//  - SERIAL_CMD_SET_ALL: number of lights, then a LightDataBlock per light, then optionally a crossfade duration (see
+//    transition.h; MW_TRANSITION_DEFAULT if omitted), which also gets written to tags; lights past the ones installed
+//    are ignored, lights missing are left alone
+//  - SERIAL_CMD_QUERY: none; replies with the selected light, whether a tag write is armed, the number of lights,
+//    then a LightDataBlock per light
+//  - SERIAL_CMD_WRITE_TAG: 1 to arm a write of the next tag swiped, 0 to disarm it; unlike holding the RFID button,
+//    it disarms itself once a tag was written
+//  - SERIAL_CMD_PROFILE: none; dumps the profiler report on Serial, as text, before replying (MW_CYCLE_PROFILE only)
+//  - SERIAL_CMD_WRITE_PROGRAM: EEPROM slot, then the program's bytecode (see patternVM.h, and tools/pattern_asm.py);
+//    lights running that slot pick it up on their next frame
+//
+// Every command gets a reply with a SERIAL_STATUS_* code, and arguments for queries. Frames are parsed incrementally, a
+// bounded number of bytes per loop() iteration, and commands only run between frames, so a batch never shows half applied.
+// ----------------------------------------------------------------
+#define SERIAL_FRAME_HEADER_SIZE 2
+#define SERIAL_FRAME_CRC_SIZE 2
+
+enum SerialCommand : byte
+{
+  SERIAL_CMD_SET_LIGHT = 0x01,
+  SERIAL_CMD_SET_ALL = 0x02,
+  SERIAL_CMD_QUERY = 0x03,
+  SERIAL_CMD_WRITE_TAG = 0x04,
+  SERIAL_CMD_PROFILE = 0x05,
+  SERIAL_CMD_WRITE_PROGRAM = 0x06
+};
+
+enum SerialStatus : byte
+{
+  SERIAL_STATUS_OK = 0x00,
+  SERIAL_STATUS_BAD_FRAME = 0x01,       // CRC mismatch, or too short to hold a header
+  SERIAL_STATUS_UNKNOWN_COMMAND = 0x02,
+  SERIAL_STATUS_BAD_LENGTH = 0x03,      // wrong number of arguments for the command
+  SERIAL_STATUS_BAD_ARGUMENT = 0x04,    // light index, pattern or program invalid; nothing was changed
+  SERIAL_STATUS_UNSUPPORTED = 0x05      // command not available in this build
+};
+
+enum SerialLightField : byte
+{
+  SERIAL_FIELD_PATTERN = 0x01,
+  SERIAL_FIELD_CYCLE_COLOR = 0x02,
+  SERIAL_FIELD_HUE = 0x04,
+  SERIAL_FIELD_SATURATION = 0x08
+};
+
+static_assert(SERIAL_FRAME_HEADER_SIZE + 3 + 1 + TAG_FORMAT_MAX_LIGHTS * sizeof(LightDataBlock) + SERIAL_FRAME_CRC_SIZE <= MW_SERIAL_CONTROL_MAX_FRAME, "MW_SERIAL_CONTROL_MAX_FRAME can't hold a full SERIAL_CMD_SET_ALL or SERIAL_CMD_QUERY reply");
+static_assert(SERIAL_FRAME_HEADER_SIZE + 1 + MW_PATTERN_PROGRAM_SIZE + SERIAL_FRAME_CRC_SIZE <= MW_SERIAL_CONTROL_MAX_FRAME, "MW_SERIAL_CONTROL_MAX_FRAME can't hold a full SERIAL_CMD_WRITE_PROGRAM");
+static_assert(MW_SERIAL_CONTROL_MAX_FRAME < 254, "frames must fit in a single COBS block");
+
+extern bool rfidWrite;
+extern bool rfidWriteOnce;
+extern byte whichObject;
+
+class SerialControl
+{
+  ILight** _lights;
+  byte _numLights;
+
+  byte _frame[MW_SERIAL_CONTROL_MAX_FRAME]; // decoded frame being received, then reply being sent
+  byte _length = 0;
+  byte _blockRemaining = 0; // data bytes left in the current COBS block; 0 when the next byte is a code byte
+  bool _blockZero = false;  // the current COBS block is followed by an implicit zero, if more data follows
+  bool _overflow = false;   // frame too long for _frame; dropped at its delimiter
+
+  void append(byte iByte)
+  {
+    if (_length < MW_SERIAL_CONTROL_MAX_FRAME)
+      _frame[_length++] = iByte;
+    else
+      _overflow = true;
+  }
+
+  void reset()
+  {
+    _length = 0;
+    _blockRemaining = 0;
+    _blockZero = false;
+    _overflow = false;
+  }
+
+  /**
+   * Feed one received byte to the COBS decoder. Returns true when a full frame was received in _frame.
+   */
+  bool receive(byte iByte)
+  {
+    if (iByte == 0x00)
+    {
+      bool complete = _length && !_overflow && !_blockRemaining;
+      if (!complete)
+        reset();
+      return complete;
+    }
+
+    if (_blockRemaining)
+    {
+      append(iByte);
+      --_blockRemaining;
+    }
+    else
+    {
+      if (_blockZero)
+        append(0x00);
+      _blockRemaining = iByte - 1;
+      _blockZero = iByte != 0xFF;
+    }
+    return false;
+  }
+
+  /**
+   * Send _frame[0.._length) as a reply frame: append its CRC, then COBS encode it straight to Serial.
+   */
+  void send()
+  {
+    uint16_t crc = tagCRC(_frame, _length);
+    _frame[_length++] = lowByte(crc);
+    _frame[_length++] = highByte(crc);
+
+    Serial.write((uint8_t)0x00);
+    byte blockStart = 0;
+    for (byte i = 0; i <= _length; ++i)
+    {
+      if (i == _length || _frame[i] == 0x00)
+      {
+        Serial.write((uint8_t)(i - blockStart + 1));
+        Serial.write(_frame + blockStart, i - blockStart);
+        blockStart = i + 1;
+      }
+    }
+    Serial.write((uint8_t)0x00);
+  }
+
+  void reply(SerialStatus iStatus)
+  {
+    _frame[1] = iStatus;
+    _length = SERIAL_FRAME_HEADER_SIZE;
+    send();
+  }
+
+  SerialStatus setLight(const byte* iArgs, byte iLength)
+  {
+    if (iLength != 6)
+      return SERIAL_STATUS_BAD_LENGTH;
+    if (iArgs[0] >= _numLights)
+      return SERIAL_STATUS_BAD_ARGUMENT;
+
+    ILight* light = _lights[iArgs[0]];
+    byte fields = iArgs[1];
+    LightDataBlock data;
+    light->serialize(&data);
+    if (fields & SERIAL_FIELD_PATTERN)
+    {
+      if (iArgs[2] >= light->patternCount())
+        return SERIAL_STATUS_BAD_ARGUMENT;
+      data.patternID = iArgs[2];
+    }
+    if (fields & SERIAL_FIELD_CYCLE_COLOR)
+      data.cycleColor = iArgs[3] != 0;
+    if (fields & SERIAL_FIELD_HUE)
+      data.hue = iArgs[4];
+    if (fields & SERIAL_FIELD_SATURATION)
+      data.saturation = iArgs[5];
+
+    if (!light->matches(&data))
+      light->deserialize(&data);
+    return SERIAL_STATUS_OK;
+  }
+
+  SerialStatus setAll(const byte* iArgs, byte iLength)
+  {
+    if (!iLength || iArgs[0] > TAG_FORMAT_MAX_LIGHTS)
+      return SERIAL_STATUS_BAD_LENGTH;
+    byte blocksLength = 1 + iArgs[0] * sizeof(LightDataBlock);
+    if (iLength != blocksLength && iLength != blocksLength + 1)
+      return SERIAL_STATUS_BAD_LENGTH;
+
+    LightConfiguration config;
+    config.transition = iLength > blocksLength ? iArgs[blocksLength] : MW_TRANSITION_DEFAULT;
+    config.numLights = iArgs[0];
+    memcpy(config.lights, iArgs + 1, config.numLights * sizeof(LightDataBlock));
+
+    for (byte i = 0; i < min(config.numLights, _numLights); ++i)
+    {
+      if (config.lights[i].patternID >= _lights[i]->patternCount())
+        return SERIAL_STATUS_BAD_ARGUMENT;
+    }
+
+    applyLightConfiguration(config, _lights, _numLights);
+    return SERIAL_STATUS_OK;
+  }
+
+  void query()
+  {
+    byte count = min(_numLights, TAG_FORMAT_MAX_LIGHTS);
+    byte* args = _frame + SERIAL_FRAME_HEADER_SIZE;
+    args[0] = whichObject;
+    args[1] = rfidWrite;
+    args[2] = count;
+    for (byte i = 0; i < count; ++i)
+      _lights[i]->serialize((LightDataBlock*)(args + 3) + i);
+
+    _frame[1] = SERIAL_STATUS_OK;
+    _length = SERIAL_FRAME_HEADER_SIZE + 3 + count * sizeof(LightDataBlock);
+    send();
+  }
+
+  void execute()
+  {
+    if (_length < SERIAL_FRAME_HEADER_SIZE + SERIAL_FRAME_CRC_SIZE)
+    {
+      reply(SERIAL_STATUS_BAD_FRAME);
+      return;
+    }
+
+    byte length = _length - SERIAL_FRAME_CRC_SIZE;
+    uint16_t crc = tagCRC(_frame, length);
+    if (_frame[length] != lowByte(crc) || _frame[length + 1] != highByte(crc))
+    {
+      reply(SERIAL_STATUS_BAD_FRAME);
+      return;
+    }
+
+    const byte* args = _frame + SERIAL_FRAME_HEADER_SIZE;
+    byte argsLength = length - SERIAL_FRAME_HEADER_SIZE;
+    switch (_frame[1])
+    {
+    case SERIAL_CMD_SET_LIGHT:
+      reply(setLight(args, argsLength));
+      break;
+    case SERIAL_CMD_SET_ALL:
+      reply(setAll(args, argsLength));
+      break;
+    case SERIAL_CMD_QUERY:
+      if (argsLength)
+        reply(SERIAL_STATUS_BAD_LENGTH);
+      else
+        query();
+      break;
+    case SERIAL_CMD_WRITE_TAG:
+      if (argsLength != 1)
+      {
+        reply(SERIAL_STATUS_BAD_LENGTH);
+        break;
+      }
+      rfidWrite = rfidWriteOnce = args[0] != 0;
+      reply(SERIAL_STATUS_OK);
+      break;
+    case SERIAL_CMD_PROFILE:
+#ifdef MW_CYCLE_PROFILE
+      profileDump();
+      reply(SERIAL_STATUS_OK);
+#else
+      reply(SERIAL_STATUS_UNSUPPORTED);
+#endif
+      break;
+    case SERIAL_CMD_WRITE_PROGRAM:
+      if (!argsLength || argsLength > 1 + MW_PATTERN_PROGRAM_SIZE)
+        reply(SERIAL_STATUS_BAD_LENGTH);
+      else
+        reply(writePatternProgram(args[0], args + 1, argsLength - 1) ? SERIAL_STATUS_OK : SERIAL_STATUS_BAD_ARGUMENT);
+      break;
+    default:
+      reply(SERIAL_STATUS_UNKNOWN_COMMAND);
+      break;
+    }
+  }
+
+public:
+  SerialControl(ILight** iLights, byte iNumLights) : _lights(iLights), _numLights(iNumLights) {}
+
+  /**
+   * Read what's pending on Serial, up to MW_SERIAL_CONTROL_BYTES_PER_UPDATE bytes, and run at most one complete command.
+   * Call once per loop() iteration, outside of the lights' update() and show(), so changes land on a frame boundary.
+   */
+  void update()
+  {
+    for (byte i = 0; i < MW_SERIAL_CONTROL_BYTES_PER_UPDATE && Serial.available(); ++i)
+    {
+      if (receive(Serial.read()))
+      {
+        execute();
+        reset();
+        return;
+      }
+    }
+  }
+};
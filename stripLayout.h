@@ -0,0 +1,207 @@
+#pragma once
+
+#include <FastLED.h>
+
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Compile-time description of the physical LED strips behind each light, and of the static arena their buffers live in.
+//
+// A light renders into a logical buffer, which only holds its unique pixels. Each physical strip (MappedStrip) is a
+// data pin and a list of Segments of that buffer, laid end to end along the strip, each one forward or reversed; strips
+// showing the same segment mirror each other. A strip whose segments are all forward, and follow each other in the
+// logical buffer, is driven straight from it, as a view; any other strip gets its own physical buffer, refilled from the
+// logical one by StripLayout::map() after each render. So per-pixel rendering work scales with unique pixels, not wired ones.
+//
+// A StripLayout lists the strips a light drives, in any number (up to STRIP_LAYOUT_MAX_STRIPS). An LEDArena lays out
+// the buffers of every light back to back in one static array, so they're placed by the linker instead of allocated on
+// the heap at setup, and their total size is known, and checked against MW_LED_ARENA_BUDGET, at compile time.
+//
+// Usage:
+//   typedef StripLayout<Strip<PIN_A, 20>, MappedStrip<PIN_B, Segment<0, 20, SEGMENT_REVERSED>, Segment<20, 10>>> MyLayout;
+//   typedef LEDArena<MyLayout, OtherLayout> Arena;
+//   PatternLightLEDStrip<MyLayout> myLight(Arena::buffer<0>());
+// ----------------------------------------------------------------
+#define STRIP_LAYOUT_MAX_STRIPS 8 // strips are tracked in a byte sized bitmask
+
+enum SegmentDirection : bool
+{
+  SEGMENT_FORWARD = false,
+  SEGMENT_REVERSED = true
+};
+
+/**
+ * Length pixels of a strip, showing logical pixels [Start, Start + Length), in that order or reversed.
+ */
+template <uint16_t Start, uint16_t Length, SegmentDirection Direction = SEGMENT_FORWARD>
+struct Segment
+{
+  static constexpr uint16_t start = Start;
+  static constexpr uint16_t length = Length;
+  static constexpr bool reversed = Direction == SEGMENT_REVERSED;
+
+  static_assert(Length > 0, "segments must have at least one LED");
+
+  static void copy(const CRGB* iLogical, CRGB* oPhysical)
+  {
+    if (reversed)
+    {
+      for (uint16_t i = 0; i < Length; ++i)
+        oPhysical[i] = iLogical[Start + Length - 1 - i];
+    }
+    else
+      memcpy(oPhysical, iLogical + Start, Length * sizeof(CRGB));
+  }
+};
+
+template <typename... Segments>
+struct SegmentList;
+
+template <>
+struct SegmentList<>
+{
+  static constexpr uint16_t length = 0;
+  static constexpr uint16_t logicalEnd = 0;
+
+  static constexpr bool continuesFrom(uint16_t) { return true; }
+  static void copy(const CRGB*, CRGB*) {}
+};
+
+template <typename First, typename... Rest>
+struct SegmentList<First, Rest...>
+{
+  typedef SegmentList<Rest...> Next;
+
+  static constexpr uint16_t length = First::length + Next::length;
+  static constexpr uint16_t logicalEnd = First::start + First::length > Next::logicalEnd ? First::start + First::length : Next::logicalEnd;
+
+  // true if the segments are all forward, and laid out in the logical buffer in the same order as on the strip, from iStart
+  static constexpr bool continuesFrom(uint16_t iStart) { return !First::reversed && First::start == iStart && Next::continuesFrom(iStart + First::length); }
+
+  static void copy(const CRGB* iLogical, CRGB* oPhysical)
+  {
+    First::copy(iLogical, oPhysical);
+    Next::copy(iLogical, oPhysical + First::length);
+  }
+};
+
+template <uint8_t DataPin, typename First, typename... Rest>
+struct MappedStrip
+{
+  typedef SegmentList<First, Rest...> Segments;
+
+  static constexpr uint8_t dataPin = DataPin;
+  static constexpr uint16_t numLEDs = Segments::length;
+  static constexpr uint16_t logicalEnd = Segments::logicalEnd; // logical pixels needed to show this strip
+  static constexpr bool isView = Segments::continuesFrom(First::start);
+  static constexpr uint16_t physicalLEDs = isView ? 0 : numLEDs; // size of its own buffer, if it needs one
+  static constexpr uint16_t viewOffset = First::start;
+};
+
+// a plain strip, showing the first NumLEDs pixels of its light
+template <uint8_t DataPin, uint16_t NumLEDs>
+using Strip = MappedStrip<DataPin, Segment<0, NumLEDs>>;
+
+template <typename... Strips>
+struct StripLayout;
+
+template <>
+struct StripLayout<>
+{
+  static constexpr byte count = 0;
+  static constexpr uint16_t bufferLEDs = 0;   // size of the logical buffer, i.e. unique pixels
+  static constexpr uint16_t physicalLEDs = 0; // size of the physical buffers of strips that can't be views
+  static constexpr uint16_t wiredLEDs = 0;    // LEDs actually driven, across all strips
+
+  static void addControllers(CRGB*, CRGB*, CLEDController**) {}
+  static void map(const CRGB*, CRGB*) {}
+};
+
+template <typename First, typename... Rest>
+struct StripLayout<First, Rest...>
+{
+  typedef StripLayout<Rest...> Next;
+
+  static constexpr byte count = 1 + Next::count;
+  static constexpr uint16_t bufferLEDs = First::logicalEnd > Next::bufferLEDs ? First::logicalEnd : Next::bufferLEDs;
+  static constexpr uint16_t physicalLEDs = First::physicalLEDs + Next::physicalLEDs;
+  static constexpr uint16_t wiredLEDs = First::numLEDs + Next::wiredLEDs;
+
+  static_assert(count <= STRIP_LAYOUT_MAX_STRIPS, "too many strips for a single light");
+
+  /**
+   * Register one FastLED controller per strip into oControllers[0..count): views show iLogical directly, other strips
+   * show their own part of iPhysical.
+   */
+  static void addControllers(CRGB* iLogical, CRGB* iPhysical, CLEDController** oControllers)
+  {
+    CRGB* leds = First::isView ? iLogical + First::viewOffset : iPhysical;
+    *oControllers = &FastLED.addLeds<WS2812B, First::dataPin, GRB>(leds, First::numLEDs).setCorrection(TypicalLEDStrip);
+    Next::addControllers(iLogical, iPhysical + First::physicalLEDs, oControllers + 1);
+  }
+
+  /**
+   * Refill the physical buffers of strips that aren't views from the logical buffer. Compiles to nothing if all are views.
+   */
+  static void map(const CRGB* iLogical, CRGB* oPhysical)
+  {
+    if (!First::isView)
+      First::Segments::copy(iLogical, oPhysical);
+    Next::map(iLogical, oPhysical + First::physicalLEDs);
+  }
+};
+
+// offset, in LEDs, of the buffers of the Ith layout in an arena
+template <byte I, typename... Layouts>
+struct LEDArenaOffset;
+
+template <typename First, typename... Rest>
+struct LEDArenaOffset<0, First, Rest...>
+{
+  static constexpr uint16_t value = 0;
+};
+
+template <byte I, typename First, typename... Rest>
+struct LEDArenaOffset<I, First, Rest...>
+{
+  static constexpr uint16_t value = First::bufferLEDs + First::physicalLEDs + LEDArenaOffset<I - 1, Rest...>::value;
+};
+
+template <typename... Layouts>
+struct LEDArenaSize;
+
+template <>
+struct LEDArenaSize<>
+{
+  static constexpr uint16_t value = 0;
+};
+
+template <typename First, typename... Rest>
+struct LEDArenaSize<First, Rest...>
+{
+  static constexpr uint16_t value = First::bufferLEDs + First::physicalLEDs + LEDArenaSize<Rest...>::value;
+};
+
+template <typename... Layouts>
+struct LEDArena
+{
+  static constexpr uint16_t leds = LEDArenaSize<Layouts...>::value;
+  static constexpr uint16_t bytes = leds * sizeof(CRGB);
+
+  static_assert(bytes <= MW_LED_ARENA_BUDGET, "LED buffers don't fit in MW_LED_ARENA_BUDGET; check the strip layouts, or raise the budget if there's SRAM to spare");
+
+  static CRGB storage[leds];
+
+  /**
+   * Buffers of the Ith layout, in the order given to the arena: its logical buffer, followed by its physical buffers.
+   */
+  template <byte I>
+  static CRGB* buffer()
+  {
+    static_assert(I < sizeof...(Layouts), "no such layout in this arena");
+    return storage + LEDArenaOffset<I, Layouts...>::value;
+  }
+};
+
+template <typename... Layouts>
+CRGB LEDArena<Layouts...>::storage[LEDArena<Layouts...>::leds];
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+#include <EEPROM.h>
+#include <MFRC522.h>
+
+#include "config.h"
+#include "tagFormat.h"
+#include "patternVM.h"
+
+// ----------------------------------------------------------------
+// UID-keyed cache of tag configurations, in EEPROM.
+// Guests mostly swipe the same handful of tags: a tag found in here is applied as soon as it's selected, and the block
+// read that follows only has to confirm (or correct) the cached configuration.
+// The least recently used entry is evicted first. Every entry carries a CRC of its configuration, so a torn EEPROM write
+// just turns into a miss.
+// An EEPROM byte takes ~3.3ms to write, so an entry is never written on the spot: it's kept in RAM, and update() writes it
+// out a byte per call, from the RFID task, once the EEPROM is done with the previous byte. Unchanged bytes are skipped, to
+// spare the EEPROM's write cycles.
+// ----------------------------------------------------------------
+struct TagCacheKey {
+  byte uidSize; // 0, or 0xFF for never written EEPROM, if the entry is free
+  byte uid[10];
+};
+
+struct TagCacheEntry {
+  TagCacheKey key;
+  uint16_t lastUse; // value of TagCache::_nextUse when this entry was last used
+  uint16_t hash;
+  LightConfiguration config;
+};
+
+static_assert(MW_TAG_CACHE_EEPROM_ADDR + MW_TAG_CACHE_ENTRIES * sizeof(TagCacheEntry) <= E2END + 1, "Tag cache doesn't fit in EEPROM");
+static_assert(MW_TAG_CACHE_EEPROM_ADDR + MW_TAG_CACHE_ENTRIES * sizeof(TagCacheEntry) <= MW_PATTERN_EEPROM_ADDR || MW_TAG_CACHE_EEPROM_ADDR >= MW_PATTERN_EEPROM_ADDR + PATTERN_EEPROM_SIZE, "Tag cache overlaps the pattern programs in EEPROM");
+
+class TagCache
+{
+  uint16_t _nextUse = 0;
+
+  TagCacheEntry _pending; // entry waiting to be written out by update(); reads of it come from here, not from EEPROM
+  byte _pendingIndex = MW_TAG_CACHE_ENTRIES; // MW_TAG_CACHE_ENTRIES if nothing is pending
+  byte _pendingByte = 0; // next byte of _pending to write
+
+  static int entryAddress(byte iEntry) { return MW_TAG_CACHE_EEPROM_ADDR + iEntry * sizeof(TagCacheEntry); }
+
+  static uint16_t configHash(const LightConfiguration& iConfig)
+  {
+    return tagCRC((const byte*)&iConfig, offsetof(LightConfiguration, lights) + iConfig.numLights * sizeof(LightDataBlock));
+  }
+
+  static bool isUsed(const TagCacheKey& iKey)
+  {
+    return iKey.uidSize != 0 && iKey.uidSize <= sizeof(iKey.uid);
+  }
+
+  static bool keyMatches(const TagCacheKey& iKey, const MFRC522::Uid& iUid)
+  {
+    return iKey.uidSize == iUid.size && memcmp(iKey.uid, iUid.uidByte, iUid.size) == 0;
+  }
+
+  /**
+   * Read entry iEntry, as it is once pending writes are done.
+   */
+  void read(byte iEntry, TagCacheEntry& oEntry)
+  {
+    if (iEntry == _pendingIndex)
+      oEntry = _pending;
+    else
+      EEPROM.get(entryAddress(iEntry), oEntry);
+  }
+
+  /**
+   * Read just the key and the LRU stamp of entry iEntry, as they are once pending writes are done.
+   */
+  void readKey(byte iEntry, TagCacheKey& oKey, uint16_t& oLastUse)
+  {
+    if (iEntry == _pendingIndex)
+    {
+      oKey = _pending.key;
+      oLastUse = _pending.lastUse;
+      return;
+    }
+    EEPROM.get(entryAddress(iEntry), oKey);
+    EEPROM.get(entryAddress(iEntry) + offsetof(TagCacheEntry, lastUse), oLastUse);
+  }
+
+  /**
+   * Queue iEntry to be written as entry iIndex. Only one entry is pending at a time: one still pending for another index
+   * is written out first, which only blocks when two tags are stored within the ~200ms an entry takes.
+   */
+  void write(byte iIndex, const TagCacheEntry& iEntry)
+  {
+    if (_pendingIndex != iIndex)
+      flush();
+    _pending = iEntry;
+    _pendingIndex = iIndex;
+    _pendingByte = 0;
+  }
+
+  /**
+   * Find the entry for iUid; returns MW_TAG_CACHE_ENTRIES if there isn't one.
+   */
+  byte find(const MFRC522::Uid& iUid)
+  {
+    TagCacheKey key;
+    uint16_t lastUse;
+    for (byte i = 0; i < MW_TAG_CACHE_ENTRIES; ++i)
+    {
+      readKey(i, key, lastUse);
+      if (keyMatches(key, iUid))
+        return i;
+    }
+    return MW_TAG_CACHE_ENTRIES;
+  }
+
+  /**
+   * Pick the entry to store a new tag in: a free one if there is any, otherwise the least recently used one.
+   */
+  byte findVictim()
+  {
+    byte victim = 0;
+    uint16_t victimAge = 0;
+    for (byte i = 0; i < MW_TAG_CACHE_ENTRIES; ++i)
+    {
+      TagCacheKey key;
+      uint16_t lastUse;
+      readKey(i, key, lastUse);
+      if (!isUsed(key))
+        return i;
+
+      uint16_t age = _nextUse - lastUse; // wraps around consistently
+      if (age >= victimAge)
+      {
+        victim = i;
+        victimAge = age;
+      }
+    }
+    return victim;
+  }
+
+  void touch(byte iIndex, TagCacheEntry& ioEntry)
+  {
+    if (ioEntry.lastUse == (uint16_t)(_nextUse - 1))
+      return; // already the most recently used; the same tag being swiped again shouldn't cost any EEPROM writes
+    ioEntry.lastUse = _nextUse++;
+    write(iIndex, ioEntry);
+  }
+
+public:
+  /**
+   * Pick up where the LRU stamps left off before the last reset, renumbering them 0, 1, ... from the least recently used
+   * entry on. Stamps wrap around, so the newest one is found with wrap-aware comparisons, which hold as long as the stamps
+   * span less than half their range; renumbering them on every boot keeps them that close.
+   */
+  void setup()
+  {
+    uint16_t ages[MW_TAG_CACHE_ENTRIES]; // the stamps at first, then how long before the newest one they were
+    bool used[MW_TAG_CACHE_ENTRIES];
+    bool anyUsed = false;
+    uint16_t newest = 0;
+
+    TagCacheKey key;
+    for (byte i = 0; i < MW_TAG_CACHE_ENTRIES; ++i)
+    {
+      readKey(i, key, ages[i]);
+      used[i] = isUsed(key);
+      if (used[i] && (!anyUsed || (int16_t)(ages[i] - newest) > 0))
+        newest = ages[i];
+      anyUsed |= used[i];
+    }
+    for (byte i = 0; i < MW_TAG_CACHE_ENTRIES; ++i)
+      ages[i] = newest - ages[i];
+
+    _nextUse = 0;
+    for (byte i = 0; i < MW_TAG_CACHE_ENTRIES; ++i)
+    {
+      if (!used[i])
+        continue;
+
+      uint16_t rank = 0; // number of entries used before this one
+      for (byte j = 0; j < MW_TAG_CACHE_ENTRIES; ++j)
+      {
+        if (used[j] && (ages[j] > ages[i] || (ages[j] == ages[i] && j < i)))
+          ++rank;
+      }
+      EEPROM.put(entryAddress(i) + offsetof(TagCacheEntry, lastUse), rank); // no EEPROM writes once the stamps are dense
+      ++_nextUse;
+    }
+  }
+
+  /**
+   * Write out the pending entry, if any: a byte per call, and only when the EEPROM is ready for it, so this never waits.
+   * Call it as often as possible.
+   */
+  void update()
+  {
+    while (_pendingIndex != MW_TAG_CACHE_ENTRIES && eeprom_is_ready())
+    {
+      int address = entryAddress(_pendingIndex) + _pendingByte;
+      byte value = ((const byte*)&_pending)[_pendingByte];
+      bool changed = EEPROM.read(address) != value;
+      if (changed)
+        EEPROM.write(address, value);
+
+      if (++_pendingByte == sizeof(TagCacheEntry))
+        _pendingIndex = MW_TAG_CACHE_ENTRIES;
+      if (changed)
+        return;
+    }
+  }
+
+  /**
+   * Write out the pending entry, if any, waiting for the EEPROM as needed.
+   */
+  void flush()
+  {
+    while (_pendingIndex != MW_TAG_CACHE_ENTRIES)
+      update();
+  }
+
+  /**
+   * Look up the last configuration read from the tag with UID iUid. Returns false if there's none, or it's corrupt.
+   */
+  bool lookup(const MFRC522::Uid& iUid, LightConfiguration& oConfig)
+  {
+    byte i = find(iUid);
+    if (i == MW_TAG_CACHE_ENTRIES)
+      return false;
+
+    TagCacheEntry entry;
+    read(i, entry);
+    if (entry.config.numLights > TAG_FORMAT_MAX_LIGHTS || entry.hash != configHash(entry.config))
+      return false;
+
+    touch(i, entry);
+    oConfig = entry.config;
+    return true;
+  }
+
+  /**
+   * Remember iConfig as the configuration of the tag with UID iUid, evicting the least recently used tag if needed.
+   */
+  void store(const MFRC522::Uid& iUid, const LightConfiguration& iConfig)
+  {
+    TagCacheEntry entry;
+    memset(&entry, 0, sizeof(entry));
+
+    byte i = find(iUid);
+    bool known = i != MW_TAG_CACHE_ENTRIES;
+    if (known)
+      readKey(i, entry.key, entry.lastUse);
+    else
+      i = findVictim();
+
+    entry.key.uidSize = iUid.size;
+    memcpy(entry.key.uid, iUid.uidByte, iUid.size);
+    if (!known || entry.lastUse != (uint16_t)(_nextUse - 1))
+      entry.lastUse = _nextUse++;
+    entry.config.transition = iConfig.transition;
+    entry.config.numLights = iConfig.numLights;
+    memcpy(entry.config.lights, iConfig.lights, iConfig.numLights * sizeof(LightDataBlock));
+    entry.hash = configHash(entry.config);
+    write(i, entry); // unchanged bytes aren't rewritten, so storing what's already cached costs no EEPROM writes at all
+  }
+
+  /**
+   * Forget the tag with UID iUid, e.g. because it no longer reads as valid.
+   */
+  void remove(const MFRC522::Uid& iUid)
+  {
+    byte i = find(iUid);
+    if (i == MW_TAG_CACHE_ENTRIES)
+      return;
+
+    TagCacheEntry entry;
+    read(i, entry);
+    entry.key.uidSize = 0;
+    write(i, entry);
+  }
+};
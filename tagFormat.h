@@ -0,0 +1,245 @@
+#pragma once
+
+#include <util/crc16.h>
+
+#include "config.h"
+#include "lights.h"
+#include "log.h"
+
+// ----------------------------------------------------------------
+// Tag data formats, starting at block MW_RFID_DATA_BLOCK_ADDR.
+//
+// Packed format (version 2 written by this version; version 1 still decoded):
+//  - byte 0: TAG_FORMAT_MAGIC
+//  - byte 1: format version in the high nibble, number of lights in the low nibble
+//  - byte 2 (version 2 and up): crossfade duration when applying the tag, in MW_TRANSITION_UNIT ms; see transition.h
+//  - 2 bytes per light, as a PackedLightData
+//  - zero padding up to the end of the last block used, except for its last 2 bytes: a CRC16 (avr-libc _crc16_update,
+//    little endian) of everything before it
+// Up to 5 lights (6 in version 1) fit in a single block, so a typical scene is a single block read.
+//
+// Legacy format (still decoded): 5 LightDataBlocks per block, then a 0xFF pad in byte 15, for as many blocks as lights need.
+// Tags without a crossfade duration use MW_TRANSITION_DEFAULT.
+//
+// Tags are decoded into a LightConfiguration, and fully validated (CRC, version, light count, pattern IDs) on the way,
+// so a torn or corrupt tag is rejected as a whole before any light is touched.
+// ----------------------------------------------------------------
+#define TAG_FORMAT_MAGIC 0x4D // 'M'
+#define TAG_FORMAT_VERSION 2
+#define TAG_FORMAT_HEADER_SIZE 3 // in the current version; version 1 has no transition byte
+#define TAG_FORMAT_CRC_SIZE 2
+#define TAG_FORMAT_MAX_LIGHTS 15
+
+#define TAG_FORMAT_LEGACY_LIGHTS_PER_BLOCK 5
+#define TAG_FORMAT_LEGACY_PAD 0xFF
+
+/**
+ * Compact version of LightDataBlock, as used by the packed tag format.
+ * Hue is stored as one of 32 evenly spaced hues, and saturation as one of the 8 levels in packedSaturationLevels.
+ */
+struct PackedLightData {
+  uint8_t cycleColor : 1;
+  uint8_t patternID : 7;
+  uint8_t hueIndex : 5;
+  uint8_t saturationIndex : 3;
+};
+
+const byte packedSaturationLevels[8] PROGMEM = {0, 36, 73, 109, 146, 182, 219, 255};
+
+static_assert(sizeof(PackedLightData) == 2, "PackedLightData must pack into 2 bytes");
+static_assert(sizeof(LightDataBlock) == 3, "LightDataBlock must pack into 3 bytes");
+
+/**
+ * The settings of a set of lights, as decoded from a tag.
+ */
+struct LightConfiguration {
+  byte transition; // see transition.h
+  byte numLights;
+  LightDataBlock lights[TAG_FORMAT_MAX_LIGHTS];
+};
+
+inline byte packedTagHeaderSize(byte iVersion)
+{
+  return iVersion == 1 ? TAG_FORMAT_HEADER_SIZE - 1 : TAG_FORMAT_HEADER_SIZE;
+}
+
+inline byte packedTagBlocks(byte iNumLights, byte iVersion = TAG_FORMAT_VERSION)
+{
+  return (packedTagHeaderSize(iVersion) + iNumLights * sizeof(PackedLightData) + TAG_FORMAT_CRC_SIZE + 15) / 16;
+}
+
+inline byte legacyTagBlocks(byte iNumLights)
+{
+  return (iNumLights + TAG_FORMAT_LEGACY_LIGHTS_PER_BLOCK - 1) / TAG_FORMAT_LEGACY_LIGHTS_PER_BLOCK;
+}
+
+static_assert((TAG_FORMAT_HEADER_SIZE + TAG_FORMAT_MAX_LIGHTS * 2 + TAG_FORMAT_CRC_SIZE + 15) / 16 <= MW_RFID_DATA_BLOCK_COUNT, "MW_RFID_DATA_BLOCK_COUNT can't hold a full packed tag");
+
+uint16_t tagCRC(const byte* iData, byte iLength)
+{
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < iLength; ++i)
+    crc = _crc16_update(crc, iData[i]);
+  return crc;
+}
+
+void packLight(const LightDataBlock& iData, PackedLightData& oPacked)
+{
+  oPacked.cycleColor = iData.cycleColor;
+  oPacked.patternID = iData.patternID;
+  oPacked.hueIndex = (iData.hue + 4) >> 3; // nearest of the 32 hues; wraps around to 0 past the last one
+  oPacked.saturationIndex = ((uint16_t)iData.saturation * 7 + 127) / 255; // nearest of packedSaturationLevels
+}
+
+void unpackLight(const PackedLightData& iPacked, LightDataBlock& oData)
+{
+  oData.cycleColor = iPacked.cycleColor;
+  oData.patternID = iPacked.patternID;
+  oData.hue = iPacked.hueIndex << 3;
+  oData.saturation = pgm_read_byte(packedSaturationLevels + iPacked.saturationIndex);
+}
+
+/**
+ * How many blocks of a tag need to be read, given its first block. Always at least 1, and at most MW_RFID_DATA_BLOCK_COUNT.
+ * iNumLights: number of lights installed, which is all a legacy tag has to go by
+ */
+byte tagBlocksNeeded(const byte* iFirstBlock, byte iNumLights)
+{
+  byte blocks = iFirstBlock[0] == TAG_FORMAT_MAGIC ? packedTagBlocks(iFirstBlock[1] & 0x0F, iFirstBlock[1] >> 4) : legacyTagBlocks(iNumLights);
+  return constrain(blocks, 1, MW_RFID_DATA_BLOCK_COUNT);
+}
+
+byte sceneTransition = MW_TRANSITION_DEFAULT; // of the last configuration applied; written to tags along with the lights
+
+/**
+ * Encode the settings of iNumLights lights, and sceneTransition, into oBlocks (MW_RFID_DATA_BLOCK_COUNT blocks of 16 bytes), in the packed format.
+ * Returns the number of blocks used, which are the only ones that need writing.
+ */
+byte encodeTag(ILight** iLights, byte iNumLights, byte* oBlocks)
+{
+  iNumLights = min(iNumLights, TAG_FORMAT_MAX_LIGHTS);
+  byte numBlocks = packedTagBlocks(iNumLights);
+
+  memset(oBlocks, 0, numBlocks * 16);
+  oBlocks[0] = TAG_FORMAT_MAGIC;
+  oBlocks[1] = (TAG_FORMAT_VERSION << 4) | iNumLights;
+  oBlocks[2] = sceneTransition;
+  for (byte i = 0; i < iNumLights; ++i)
+  {
+    LightDataBlock data;
+    iLights[i]->serialize(&data);
+    packLight(data, ((PackedLightData*)(oBlocks + TAG_FORMAT_HEADER_SIZE))[i]);
+  }
+
+  byte crcOffset = numBlocks * 16 - TAG_FORMAT_CRC_SIZE;
+  uint16_t crc = tagCRC(oBlocks, crcOffset);
+  oBlocks[crcOffset] = lowByte(crc);
+  oBlocks[crcOffset + 1] = highByte(crc);
+
+  return numBlocks;
+}
+
+bool decodePackedTag(const byte* iBlocks, byte iNumBlocks, LightConfiguration& oConfig)
+{
+  byte version = iBlocks[1] >> 4;
+  byte tagLights = iBlocks[1] & 0x0F;
+  if (version < 1 || version > TAG_FORMAT_VERSION)
+  {
+    logEvent(LOG_TAG_VERSION_UNSUPPORTED, version);
+    return false;
+  }
+
+  byte headerSize = packedTagHeaderSize(version);
+  byte numBlocks = packedTagBlocks(tagLights, version);
+  if (numBlocks > iNumBlocks)
+  {
+    logEvent(LOG_TAG_TRUNCATED);
+    return false;
+  }
+
+  byte crcOffset = numBlocks * 16 - TAG_FORMAT_CRC_SIZE;
+  uint16_t crc = tagCRC(iBlocks, crcOffset);
+  if (iBlocks[crcOffset] != lowByte(crc) || iBlocks[crcOffset + 1] != highByte(crc))
+  {
+    logEvent(LOG_TAG_CRC_MISMATCH);
+    return false;
+  }
+
+  oConfig.transition = version == 1 ? MW_TRANSITION_DEFAULT : iBlocks[2];
+  oConfig.numLights = min(tagLights, TAG_FORMAT_MAX_LIGHTS);
+  for (byte i = 0; i < oConfig.numLights; ++i)
+    unpackLight(((const PackedLightData*)(iBlocks + headerSize))[i], oConfig.lights[i]);
+
+  return true;
+}
+
+bool decodeLegacyTag(const byte* iBlocks, byte iNumBlocks, byte iNumLights, LightConfiguration& oConfig)
+{
+  oConfig.transition = MW_TRANSITION_DEFAULT;
+  oConfig.numLights = min(iNumLights, TAG_FORMAT_MAX_LIGHTS);
+
+  byte numBlocks = legacyTagBlocks(oConfig.numLights);
+  if (numBlocks > iNumBlocks)
+  {
+    logEvent(LOG_TAG_TRUNCATED);
+    return false;
+  }
+
+  for (byte block = 0; block < numBlocks; ++block)
+  {
+    if (iBlocks[block * 16 + 15] != TAG_FORMAT_LEGACY_PAD)
+    {
+      logEvent(LOG_TAG_UNRECOGNIZED);
+      return false;
+    }
+  }
+
+  for (byte i = 0; i < oConfig.numLights; ++i)
+    oConfig.lights[i] = ((const LightDataBlock*)(iBlocks + (i / TAG_FORMAT_LEGACY_LIGHTS_PER_BLOCK) * 16))[i % TAG_FORMAT_LEGACY_LIGHTS_PER_BLOCK];
+
+  return true;
+}
+
+/**
+ * Decode and validate the data read from a tag (iNumBlocks blocks of 16 bytes), in either format, into oConfig.
+ * Returns false if the tag was rejected, in which case oConfig must not be used.
+ */
+bool decodeTag(const byte* iBlocks, byte iNumBlocks, ILight** iLights, byte iNumLights, LightConfiguration& oConfig)
+{
+  bool ok = iBlocks[0] == TAG_FORMAT_MAGIC ? decodePackedTag(iBlocks, iNumBlocks, oConfig) : decodeLegacyTag(iBlocks, iNumBlocks, iNumLights, oConfig);
+  if (!ok)
+    return false;
+
+  for (byte i = 0; i < min(oConfig.numLights, iNumLights); ++i)
+  {
+    if (oConfig.lights[i].patternID >= iLights[i]->patternCount())
+    {
+      logEvent(LOG_TAG_INVALID_PATTERN, i);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+/**
+ * Apply a configuration to the lights, crossfading over its transition. Extra lights in the configuration aren't installed here, and lights missing from it are left alone.
+ * Lights that already match their settings aren't touched at all, so re-applying the active configuration is a no-op.
+ * Returns true if any light changed.
+ */
+bool applyLightConfiguration(const LightConfiguration& iConfig, ILight** ioLights, byte iNumLights)
+{
+  byte count = min(iConfig.numLights, iNumLights);
+  sceneTransition = iConfig.transition;
+
+  bool changed = false;
+  for (byte i = 0; i < count; ++i)
+  {
+    if (!ioLights[i]->matches(&iConfig.lights[i]))
+    {
+      ioLights[i]->deserialize(&iConfig.lights[i], iConfig.transition);
+      changed = true;
+    }
+  }
+  return changed;
+}
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <MFRC522.h>
+#include <util/crc16.h>
+
+#include "clock.h"
+#include "config.h"
+#include "rfid.h"
+#include "tagFormat.h"
+
+extern const byte NUM_LIGHTOBJECTS;
+
+static_assert(blocksAvoidTrailers(MW_RFID_DATA_BLOCK_ADDR, MW_RFID_DATA_BLOCK_COUNT), "MW_RFID_DATA_BLOCK_ADDR/COUNT overlap a sector trailer");
+
+// ----------------------------------------------------------------
+// Non-blocking tag reader.
+// Drives the MFRC522 at register level as a state machine: REQA -> anticollision -> select (for each cascade level of the
+// UID) -> authenticate -> read each data block the tag's format needs -> halt. Reading a tag is thus spread over several loop() iterations, instead
+// of freezing the animations for the whole exchange.
+// Each call to update() spends at most MW_RFID_TIME_SLICE_US on the reader: commands are started on the reader, then only
+// polled for completion through its IRQ register, never busy-waited on. Timeouts come from the reader's own timer, which
+// the library's PCD_Init() sets up for 25ms.
+//
+// NB: collisions between several tags in front of the reader aren't resolved; the attempt is dropped and retried on the next poll.
+// ----------------------------------------------------------------
+class TagReader
+{
+public:
+  enum Result : byte
+  {
+    TAG_READER_BUSY,     // nothing to report (yet)
+    TAG_READER_IDENTIFIED, // a compatible tag was selected, and is about to be read; its UID is in the reader's uid
+    TAG_READER_SELECTED, // a compatible tag was selected, and no read was requested: the tag is the caller's to use (blocking library calls are fine), and then to give back with release()
+    TAG_READER_READ      // a compatible tag was read; its blockCount() data blocks are available from block() until the next tag is read
+  };
+
+private:
+  enum State : byte
+  {
+    STATE_IDLE,          // waiting for the next poll
+    STATE_REQA,          // REQA sent, waiting for an ATQA from any tag
+    STATE_ANTICOLLISION, // anticollision sent for the current cascade level, waiting for that part of the UID
+    STATE_SELECT,        // select sent for the current cascade level, waiting for a SAK
+    STATE_SELECTED,      // tag handed over to the caller
+    STATE_AUTH,          // authenticating for the current block
+    STATE_READ,          // read sent for the current block, waiting for its data
+    STATE_HALT           // HLTA sent; tags never answer it, so this is just waiting for the reader to be done
+  };
+
+  // ComIrqReg bits
+  static const byte IRQ_TIMER = 0x01;
+  static const byte IRQ_IDLE = 0x10;
+  static const byte IRQ_RX = 0x20;
+
+  // ErrorReg bits
+  static const byte ERROR_COLLISION = 0x08;
+  static const byte ERROR_FATAL = 0x13; // BufferOvfl, ParityErr, ProtocolErr
+
+  static const byte STATUS2_CRYPTO1_ON = 0x08;
+  static const byte SAK_CASCADE = 0x04;
+
+  // backup for the reader's own timeout, in case its timer IRQ never comes
+  static const uint16_t COMMAND_TIMEOUT = 50;
+
+  MFRC522& _reader;
+  State _state = STATE_IDLE;
+  Result _result = TAG_READER_BUSY;
+  bool _readData = true;
+  byte _cascadeLevel = 0;
+  byte _block = 0;
+  byte _authenticatedTrailer = 0xFF; // sector trailer of the sector we're authenticated for, if any
+  uint32_t _lastPoll = 0;
+  uint16_t _commandStart = 0;
+
+  byte _command[12];       // last command sent; anticollision responses are completed into it to build the select
+  byte _response[18];      // up to a block of data + CRC_A
+  byte _responseLength = 0;
+  byte _responseBits = 0;  // number of valid bits in the last byte of the response, 0 meaning all of them
+
+  byte _blocks[MW_RFID_DATA_BLOCK_COUNT][16];
+
+  static uint16_t crcA(const byte* iData, byte iLength)
+  {
+    uint16_t crc = 0x6363; // ISO/IEC 14443-3 CRC_A, which is the reflected CCITT polynomial with a different preset
+    for (byte i = 0; i < iLength; ++i)
+      crc = _crc_ccitt_update(crc, iData[i]);
+    return crc;
+  }
+
+  bool responseCRCIsValid() const
+  {
+    if (_responseLength < 3 || _responseBits != 0)
+      return false;
+    uint16_t crc = crcA(_response, _responseLength - 2);
+    return _response[_responseLength - 2] == lowByte(crc) && _response[_responseLength - 1] == highByte(crc);
+  }
+
+  void startCommand(MFRC522::PCD_Command iCommand, byte iLength, byte iBitFraming = 0)
+  {
+    _reader.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);  // stop any active command
+    _reader.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);                // clear all IRQ bits
+    _reader.PCD_WriteRegister(MFRC522::FIFOLevelReg, 0x80);             // flush the FIFO
+    _reader.PCD_WriteRegister(MFRC522::FIFODataReg, iLength, _command);
+    _reader.PCD_WriteRegister(MFRC522::BitFramingReg, iBitFraming);
+    _reader.PCD_WriteRegister(MFRC522::CommandReg, iCommand);
+    if (iCommand == MFRC522::PCD_Transceive)
+      _reader.PCD_SetRegisterBitMask(MFRC522::BitFramingReg, 0x80);     // StartSend
+    _commandStart = millis();
+  }
+
+  void transceiveWithCRC(byte iLength)
+  {
+    uint16_t crc = crcA(_command, iLength);
+    _command[iLength] = lowByte(crc);
+    _command[iLength + 1] = highByte(crc);
+    startCommand(MFRC522::PCD_Transceive, iLength + 2);
+  }
+
+  /**
+   * Check on the running command, without waiting.
+   * Returns false if it's still running; otherwise, returns true with its outcome in oStatus, and its response (if any) loaded in _response.
+   */
+  bool commandDone(byte iWaitIRq, MFRC522::StatusCode& oStatus)
+  {
+    byte irq = _reader.PCD_ReadRegister(MFRC522::ComIrqReg);
+    if (!(irq & iWaitIRq))
+    {
+      if ((irq & IRQ_TIMER) || (uint16_t)((uint16_t)millis() - _commandStart) > COMMAND_TIMEOUT)
+      {
+        _reader.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+        oStatus = MFRC522::STATUS_TIMEOUT;
+        return true;
+      }
+      return false;
+    }
+
+    byte error = _reader.PCD_ReadRegister(MFRC522::ErrorReg);
+    if (error & ERROR_FATAL)
+    {
+      oStatus = MFRC522::STATUS_ERROR;
+      return true;
+    }
+
+    _responseLength = _reader.PCD_ReadRegister(MFRC522::FIFOLevelReg);
+    if (_responseLength > sizeof(_response))
+    {
+      oStatus = MFRC522::STATUS_NO_ROOM;
+      return true;
+    }
+    _reader.PCD_ReadRegister(MFRC522::FIFODataReg, _responseLength, _response);
+    _responseBits = _reader.PCD_ReadRegister(MFRC522::ControlReg) & 0x07;
+
+    oStatus = (error & ERROR_COLLISION) ? MFRC522::STATUS_COLLISION : MFRC522::STATUS_OK;
+    return true;
+  }
+
+  void startRequest()
+  {
+    // reset baud rates and modulation width, like PICC_IsNewCardPresent() does
+    _reader.PCD_WriteRegister(MFRC522::TxModeReg, 0x00);
+    _reader.PCD_WriteRegister(MFRC522::RxModeReg, 0x00);
+    _reader.PCD_WriteRegister(MFRC522::ModWidthReg, 0x26);
+    _reader.PCD_ClearRegisterBitMask(MFRC522::CollReg, 0x80); // ValuesAfterColl: all received bits are cleared after a collision
+
+    _command[0] = MFRC522::PICC_CMD_REQA;
+    startCommand(MFRC522::PCD_Transceive, 1, 0x07); // REQA is a short frame, 7 bits
+    _reader.uid.size = 0;
+    _cascadeLevel = 0;
+    _authenticatedTrailer = 0xFF;
+    _state = STATE_REQA;
+  }
+
+  void startAnticollision()
+  {
+    static const byte selectCommands[] = {MFRC522::PICC_CMD_SEL_CL1, MFRC522::PICC_CMD_SEL_CL2, MFRC522::PICC_CMD_SEL_CL3};
+
+    _command[0] = selectCommands[_cascadeLevel];
+    _command[1] = 0x20; // NVB: no bits of the UID known yet, so every tag answers with its whole UID CLn
+    startCommand(MFRC522::PCD_Transceive, 2);
+    _state = STATE_ANTICOLLISION;
+  }
+
+  void startSelect()
+  {
+    _command[1] = 0x70; // NVB: the whole UID CLn + BCC follows
+    memcpy(_command + 2, _response, 5);
+    transceiveWithCRC(7);
+    _state = STATE_SELECT;
+  }
+
+  void startAuth()
+  {
+    byte blockAddr = MW_RFID_DATA_BLOCK_ADDR + _block;
+
+    _command[0] = MFRC522::PICC_CMD_MF_AUTH_KEY_A;
+    _command[1] = sectorTrailer(blockAddr);
+    memcpy(_command + 2, mifareDefaultKey.keyByte, 6);
+    memcpy(_command + 8, _reader.uid.uidByte + _reader.uid.size - 4, 4); // last 4 bytes of the UID
+    startCommand(MFRC522::PCD_MFAuthent, 12);
+    _state = STATE_AUTH;
+  }
+
+  void startRead()
+  {
+    _command[0] = MFRC522::PICC_CMD_MF_READ;
+    _command[1] = MW_RFID_DATA_BLOCK_ADDR + _block;
+    transceiveWithCRC(2);
+    _state = STATE_READ;
+  }
+
+  // the next block only needs authenticating if it's in another sector than the previous one
+  void startAuthOrRead()
+  {
+    if (sectorTrailer(MW_RFID_DATA_BLOCK_ADDR + _block) == _authenticatedTrailer)
+      startRead();
+    else
+      startAuth();
+  }
+
+  void startHalt()
+  {
+    _command[0] = MFRC522::PICC_CMD_HLTA;
+    _command[1] = 0;
+    transceiveWithCRC(2);
+    _state = STATE_HALT;
+  }
+
+  bool fail(MFRC522::StatusCode iStatus)
+  {
+    logEvent(LOG_TAG_READ_FAILED, iStatus, (byte)(MW_RFID_DATA_BLOCK_ADDR + _block));
+    startHalt();
+    return true;
+  }
+
+  /**
+   * Advance the state machine by at most one step.
+   * Returns true if calling it again right away could make more progress, false if there's nothing left to do until the next update().
+   */
+  bool step()
+  {
+    MFRC522::StatusCode status;
+
+    switch (_state)
+    {
+    case STATE_REQA:
+      if (!commandDone(IRQ_RX | IRQ_IDLE, status))
+        return true;
+      if (status != MFRC522::STATUS_OK && status != MFRC522::STATUS_COLLISION) // no tag; several tags answering still means there's something to select
+      {
+        _state = STATE_IDLE;
+        return false;
+      }
+      startAnticollision();
+      return true;
+
+    case STATE_ANTICOLLISION:
+      if (!commandDone(IRQ_RX | IRQ_IDLE, status))
+        return true;
+      if (status != MFRC522::STATUS_OK || _responseLength != 5 || _responseBits != 0 || (_response[0] ^ _response[1] ^ _response[2] ^ _response[3]) != _response[4])
+      {
+        startHalt();
+        return true;
+      }
+      startSelect();
+      return true;
+
+    case STATE_SELECT:
+    {
+      if (!commandDone(IRQ_RX | IRQ_IDLE, status))
+        return true;
+      if (status != MFRC522::STATUS_OK || _responseLength != 3 || !responseCRCIsValid())
+      {
+        startHalt();
+        return true;
+      }
+
+      // the UID CLn is still in the select command; if the UID doesn't end at this cascade level, its first byte is the cascade tag
+      byte sak = _response[0];
+      bool cascade = sak & SAK_CASCADE;
+      memcpy(_reader.uid.uidByte + _reader.uid.size, _command + (cascade ? 3 : 2), cascade ? 3 : 4);
+      _reader.uid.size += cascade ? 3 : 4;
+      if (cascade)
+      {
+        if (++_cascadeLevel == 3)
+        {
+          startHalt();
+          return true;
+        }
+        startAnticollision();
+        return true;
+      }
+      _reader.uid.sak = sak;
+
+      logTagDebug(_reader);
+      if (!checkCompatibleTag(_reader))
+      {
+        startHalt();
+        return true;
+      }
+
+      if (!_readData)
+      {
+        _state = STATE_SELECTED;
+        _result = TAG_READER_SELECTED;
+        return false;
+      }
+
+      _block = 0;
+      startAuthOrRead();
+      _result = TAG_READER_IDENTIFIED; // end the slice here, so this gets reported before the read completes
+      return false;
+    }
+
+    case STATE_AUTH:
+      if (!commandDone(IRQ_IDLE, status))
+        return true;
+      if (status == MFRC522::STATUS_OK && !(_reader.PCD_ReadRegister(MFRC522::Status2Reg) & STATUS2_CRYPTO1_ON))
+        status = MFRC522::STATUS_ERROR;
+      if (status != MFRC522::STATUS_OK)
+        return fail(status);
+      _authenticatedTrailer = _command[1];
+      startRead();
+      return true;
+
+    case STATE_READ:
+      if (!commandDone(IRQ_RX | IRQ_IDLE, status))
+        return true;
+      if (status == MFRC522::STATUS_OK && _responseLength == 1 && _responseBits == 4)
+        status = MFRC522::STATUS_MIFARE_NACK;
+      else if (status == MFRC522::STATUS_OK && (_responseLength != 18 || !responseCRCIsValid()))
+        status = MFRC522::STATUS_CRC_WRONG;
+      if (status != MFRC522::STATUS_OK)
+        return fail(status);
+
+      // logEvent(LOG_TAG_BLOCK_READ, (byte)(MW_RFID_DATA_BLOCK_ADDR + _block), LogBytes{_response, 16});
+      memcpy(_blocks[_block], _response, 16);
+      if (++_block < tagBlocksNeeded(_blocks[0], NUM_LIGHTOBJECTS))
+      {
+        startAuthOrRead();
+        return true;
+      }
+      _result = TAG_READER_READ;
+      startHalt();
+      return true;
+
+    case STATE_HALT:
+      if (!commandDone(IRQ_RX | IRQ_IDLE, status))
+        return true;
+      _reader.PCD_StopCrypto1();
+      _state = STATE_IDLE;
+      return false;
+
+    default: // STATE_IDLE, STATE_SELECTED
+      return false;
+    }
+  }
+
+public:
+  TagReader(MFRC522& reader) : _reader(reader) {};
+
+  /**
+   * Give the reader its time slice for this frame, starting a new tag detection if it's idle and MW_RFID_POLL_INTERVAL has passed.
+   * iReadData: whether to read the data blocks of the next tag detected, or hand it over as selected instead (used for writing)
+   */
+  Result update(bool iReadData)
+  {
+    _result = TAG_READER_BUSY;
+
+    if (_state == STATE_IDLE)
+    {
+      uint32_t now = clockMillis();
+      if (now - _lastPoll < MW_RFID_POLL_INTERVAL)
+        return _result;
+
+      _lastPoll = now;
+      _readData = iReadData;
+      startRequest();
+    }
+
+    uint16_t start = micros();
+    while (step() && (uint16_t)((uint16_t)micros() - start) < MW_RFID_TIME_SLICE_US)
+      ;
+
+    return _result;
+  }
+
+  /**
+   * Take back a tag handed over by TAG_READER_SELECTED, once the caller is done with it and has halted it.
+   */
+  void release()
+  {
+    if (_state == STATE_SELECTED)
+      _state = STATE_IDLE;
+  }
+
+  const byte* block(byte iBlockOffset) const { return _blocks[iBlockOffset]; }
+  byte blockCount() const { return _block; }
+};
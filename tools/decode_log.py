@@ -0,0 +1,173 @@
+#!/usr/bin/env python3
+"""
+Decode the binary event log frames sent by log.h back into text.
+
+Reads a capture of the MW3 Serial output (a file, stdin, or a serial port with --port, which needs pyserial), and prints
+it with every log frame replaced by its formatted event. Plain text printed on Serial is passed through as is, and other
+frames (e.g. serialControl.h replies) are shown as hex.
+
+Events and their formats are read from the LOG_EVENTS list in log.h, so this never needs updating when events are added.
+
+    tools/decode_log.py capture.bin
+    tools/decode_log.py --port /dev/ttyACM0
+"""
+
+import argparse
+import os
+import re
+import sys
+
+LOG_FRAME_MARKER = 0xFF
+
+# MFRC522::StatusCode and MFRC522::PICC_Type, as named by GetStatusCodeName() and PICC_GetTypeName()
+STATUS_NAMES = {
+    0: "Success.",
+    1: "Error in communication.",
+    2: "Collision detected.",
+    3: "Timeout in communication.",
+    4: "A buffer is not big enough.",
+    5: "Internal error in the code. Should not happen.",
+    6: "Invalid argument.",
+    7: "The CRC_A does not match.",
+    0xFF: "A MIFARE PICC responded with NAK.",
+}
+
+PICC_TYPE_NAMES = {
+    1: "PICC compliant with ISO/IEC 14443-4",
+    2: "PICC compliant with ISO/IEC 18092 (NFC)",
+    3: "MIFARE Mini, 320 bytes",
+    4: "MIFARE 1KB",
+    5: "MIFARE 4KB",
+    6: "MIFARE Ultralight or Ultralight C",
+    7: "MIFARE Plus",
+    8: "MIFARE DESFire",
+    9: "MIFARE TNP3XXX",
+    0xFF: "SAK indicates UID is not complete.",
+}
+
+
+def load_events(log_header):
+    """Return the (name, format) of every event in LOG_EVENTS, in ID order."""
+    with open(log_header) as f:
+        source = f.read()
+    block = re.search(r"#define LOG_EVENTS\(X\)(.*?)\n\n", source, re.S)
+    if not block:
+        sys.exit("LOG_EVENTS not found in " + log_header)
+    return re.findall(r'X\((\w+),\s*"((?:[^"\\]|\\.)*)"\)', block.group(1))
+
+
+def cobs_decode(data):
+    """Decode a COBS block, without its delimiters. Returns None if it isn't valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        block = data[i + 1:i + code]
+        if len(block) != code - 1:
+            return None
+        out += block
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def format_event(events, record):
+    """Format a log record (event ID, then arguments) as text."""
+    event_id, args = record[0], record[1:]
+    if event_id >= len(events):
+        return "<unknown log event %d: %s>" % (event_id, args.hex(" "))
+    name, fmt = events[event_id]
+
+    out = []
+    pos = 0
+    i = 0
+    try:
+        while i < len(fmt):
+            c = fmt[i]
+            i += 1
+            if c != "%":
+                out.append(c)
+                continue
+            spec = fmt[i]
+            i += 1
+            if spec == "u":
+                out.append(str(args[pos]))
+                pos += 1
+            elif spec == "U":
+                out.append(str(args[pos] | args[pos + 1] << 8))
+                pos += 2
+            elif spec in "bh":
+                length = args[pos]
+                data = args[pos + 1:pos + 1 + length]
+                if len(data) != length:
+                    raise IndexError
+                if spec == "b":
+                    out.append("{ " + ", ".join("0x%02X" % b for b in data) + " }")
+                else:
+                    out.append("".join(" %02X" % b for b in data))
+                pos += 1 + length
+            elif spec == "m":
+                out.append(STATUS_NAMES.get(args[pos], "Unknown error"))
+                pos += 1
+            elif spec == "p":
+                out.append(PICC_TYPE_NAMES.get(args[pos], "Unknown type"))
+                pos += 1
+            else:
+                out.append("%" + spec)
+    except IndexError:
+        return "<truncated %s: %s>" % (name, args.hex(" "))
+    return "".join(out)
+
+
+def decode_chunk(events, chunk):
+    """Decode what was between two 0x00 delimiters: a log frame, another frame, or plain text."""
+    decoded = cobs_decode(chunk)
+    if decoded and decoded[0] == LOG_FRAME_MARKER and len(decoded) > 1:
+        return format_event(events, decoded[1:]) + "\n"
+    if decoded is not None and not all(32 <= b < 127 or b in b"\r\n\t" for b in chunk):
+        return "<frame: %s>\n" % decoded.hex(" ")
+    return chunk.decode("ascii", "replace")
+
+
+def stream(source):
+    while True:
+        data = source.read(1)
+        if not data:
+            return
+        yield data[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="file to decode; stdin if omitted")
+    parser.add_argument("--port", help="serial port to read from instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--log-header", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "log.h"))
+    args = parser.parse_args()
+
+    events = load_events(args.log_header)
+
+    if args.port:
+        import serial  # pyserial
+        source = serial.Serial(args.port, args.baud)
+    elif args.capture:
+        source = open(args.capture, "rb")
+    else:
+        source = sys.stdin.buffer
+
+    chunk = bytearray()
+    for byte in stream(source):
+        if byte != 0:
+            chunk.append(byte)
+            continue
+        if chunk:
+            sys.stdout.write(decode_chunk(events, bytes(chunk)))
+            sys.stdout.flush()
+            chunk = bytearray()
+    if chunk:
+        sys.stdout.write(chunk.decode("ascii", "replace"))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+"""
+Assemble pattern programs for the bytecode VM in patternVM.h, and check they run within its cycle budget.
+
+A program is one instruction per line: the op name, without its OP_ prefix, then its operands, separated by spaces or
+commas. Registers are r0 to r7; jump offsets are given as labels ("loop:" on a line of its own, or before an instruction).
+Comments start with ';' or '#'.
+
+    ; a dot running along the strip, over a dim background
+        ldi r5, 0
+        ldi r6, 255
+        ldi r7, 40
+        fill r5, r6, r0, r1, r7
+        beat r4, 30
+        ldi r7, 1
+        chase r4, r7, r0, r1, r2
+        end
+
+The cost of a frame is estimated with the same per-op costs as the VM (read from PATTERN_OPS), assuming the worst for
+anything that isn't known before the program runs: hue, saturation, etc., generators, and registers kept from the
+previous frame. Programs over MW_PATTERN_CYCLE_BUDGET (read from config.h) on --leds pixels are rejected, since the VM
+would cut them short every frame.
+
+Prints the program as a C array, or stores it in an EEPROM slot through SERIAL_CMD_WRITE_PROGRAM with --port (needs pyserial).
+
+    tools/pattern_asm.py dot.pat --leds 142
+    tools/pattern_asm.py dot.pat --leds 142 --port /dev/ttyACM0 --slot 0
+"""
+
+import argparse
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+NUM_REGISTERS = 8
+MAX_SIMULATED_OPS = 100000
+
+SERIAL_CMD_WRITE_PROGRAM = 0x06
+SERIAL_STATUS_NAMES = ["OK", "bad frame", "unknown command", "bad length", "bad argument", "unsupported"]
+
+
+def load_ops(vm_header):
+    """Return {name: (opcode, operands, cycles, pixel cycles)} for every op in PATTERN_OPS."""
+    with open(vm_header) as f:
+        source = f.read()
+    block = re.search(r"#define PATTERN_OPS\(X\)(.*?)\n\n", source, re.S)
+    if not block:
+        sys.exit("PATTERN_OPS not found in " + vm_header)
+    ops = re.findall(r'X\(OP_(\w+),\s*"(\w*)",\s*(\d+),\s*(\d+)\)', block.group(1))
+    return {name.lower(): (i, operands, int(cycles), int(pixel_cycles)) for i, (name, operands, cycles, pixel_cycles) in enumerate(ops)}
+
+
+def load_define(header, name):
+    with open(header) as f:
+        match = re.search(r"#define %s (\d+)" % name, f.read())
+    if not match:
+        sys.exit("%s not found in %s" % (name, header))
+    return int(match.group(1))
+
+
+def parse_register(token, line_number):
+    match = re.fullmatch(r"[rR](\d+)", token)
+    if not match or int(match.group(1)) >= NUM_REGISTERS:
+        sys.exit("line %d: expected a register, r0 to r%d, got %r" % (line_number, NUM_REGISTERS - 1, token))
+    return int(match.group(1))
+
+
+def parse_immediate(token, line_number):
+    try:
+        value = int(token, 0)
+    except ValueError:
+        sys.exit("line %d: expected a number, got %r" % (line_number, token))
+    if not 0 <= value <= 255:
+        sys.exit("line %d: %d doesn't fit in a byte" % (line_number, value))
+    return value
+
+
+def assemble(source, ops):
+    """Return the program's bytecode."""
+    instructions = []  # (line number, op, operand tokens, address)
+    labels = {}
+    address = 0
+    for line_number, line in enumerate(source.splitlines(), 1):
+        line = re.split(r"[;#]", line, 1)[0].strip()
+        while ":" in line:
+            label, line = line.split(":", 1)
+            labels[label.strip()] = address
+            line = line.strip()
+        if not line:
+            continue
+        tokens = line.replace(",", " ").split()
+        name = tokens[0].lower()
+        if name not in ops:
+            sys.exit("line %d: unknown op %r" % (line_number, tokens[0]))
+        operands = ops[name][1]
+        if len(tokens) - 1 != len(operands):
+            sys.exit("line %d: %s takes %d operands" % (line_number, name, len(operands)))
+        instructions.append((line_number, name, tokens[1:], address))
+        address += 1 + len(operands)
+
+    code = []
+    for line_number, name, tokens, address in instructions:
+        opcode, operands = ops[name][:2]
+        code.append(opcode)
+        next_address = address + 1 + len(operands)
+        for kind, token in zip(operands, tokens):
+            if kind == "r":
+                code.append(parse_register(token, line_number))
+            elif kind == "i":
+                code.append(parse_immediate(token, line_number))
+            else:
+                if token not in labels:
+                    sys.exit("line %d: unknown label %r" % (line_number, token))
+                offset = labels[token] - next_address
+                if not -128 <= offset <= 127:
+                    sys.exit("line %d: %s is too far away" % (line_number, token))
+                code.append(offset & 0xFF)
+    if labels and max(labels.values()) >= len(code):
+        sys.exit("labels must be followed by an instruction")
+    return code
+
+
+def pixel_range(start, end, num_leds):
+    """Number of pixels covered by positions start to end, as PatternVM::range(); the whole strip if either is unknown."""
+    if start is None or end is None:
+        return num_leds
+    first = (start * num_leds) >> 8
+    last = ((end + 1) * num_leds) >> 8
+    return last - first if start <= end and last > first else 0
+
+
+def estimate_cycles(code, ops, num_leds, budget):
+    """
+    Cycles one frame of the program takes on num_leds pixels, like PatternVM::run() counts them, running the register
+    arithmetic and jumps for real. Unknown values (None) are assumed to cover the whole strip in draw ops, and to loop 256
+    times in djnz. Stops counting once over budget.
+    """
+    by_opcode = {opcode: (name, operands, cycles, pixel_cycles) for name, (opcode, operands, cycles, pixel_cycles) in ops.items()}
+    r = [None] * NUM_REGISTERS
+    cycles = 0
+    pc = 0
+    for _ in range(MAX_SIMULATED_OPS):
+        if pc >= len(code) or cycles > budget:
+            break
+        name, operands, op_cycles, pixel_cycles = by_opcode[code[pc]]
+        a = code[pc + 1:pc + 1 + len(operands)]
+        pc += 1 + len(operands)
+
+        count = 0
+        if name in ("fill", "gradient", "palette"):
+            count = pixel_range(r[a[0]], r[a[1]], num_leds)
+        elif name == "chase":
+            count = num_leds if r[a[1]] is None else min(r[a[1]], num_leds)
+        elif name == "fade":
+            count = num_leds
+        cycles += op_cycles + pixel_cycles * count
+
+        if name == "end":
+            break
+        elif name == "ldi":
+            r[a[0]] = a[1]
+        elif name == "mov":
+            r[a[0]] = r[a[1]]
+        elif name in ("add", "sub"):
+            if r[a[0]] is not None and r[a[1]] is not None:
+                r[a[0]] = (r[a[0]] + r[a[1]] if name == "add" else r[a[0]] - r[a[1]]) & 0xFF
+            else:
+                r[a[0]] = None
+        elif name == "addi":
+            r[a[0]] = None if r[a[0]] is None else (r[a[0]] + a[1]) & 0xFF
+        elif name in ("scale", "sin", "beat", "beatsin", "time", "random"):
+            r[a[0]] = None
+        elif name == "djnz":
+            counter = 0 if r[a[0]] is None else r[a[0]]  # unknown: assume the longest loop
+            r[a[0]] = (counter - 1) & 0xFF
+            if r[a[0]]:
+                pc += a[1] - 256 if a[1] > 127 else a[1]
+    else:
+        cycles = budget + 1  # doesn't terminate
+    return cycles
+
+
+def cobs_encode(data):
+    out = bytearray()
+    block = bytearray()
+    for byte in data:
+        if byte == 0:
+            out += bytes([len(block) + 1]) + block
+            block = bytearray()
+        else:
+            block.append(byte)
+    return bytes(out + bytes([len(block) + 1]) + block)
+
+
+def cobs_decode(data):
+    """Decode a COBS block, without its delimiters. Returns None if it isn't valid COBS."""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        block = data[i + 1:i + code]
+        if len(block) != code - 1:
+            return None
+        out += block
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def crc16(data):
+    """Same as tagCRC() and _crc16_update(): CRC-16/MODBUS."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+
+def upload(code, port, baud, slot):
+    import serial  # only needed for uploads
+
+    frame = bytes([1, SERIAL_CMD_WRITE_PROGRAM, slot] + code)
+    crc = crc16(frame)
+    frame += bytes([crc & 0xFF, crc >> 8])
+    with serial.Serial(port, baud, timeout=2) as link:
+        link.write(b"\x00" + cobs_encode(frame) + b"\x00")
+        # skip text and log frames until our reply shows up
+        for chunk in iter(lambda: link.read_until(b"\x00"), b""):
+            chunk = chunk.rstrip(b"\x00")
+            if not chunk or chunk[0] == 0xFF:
+                continue
+            reply = cobs_decode(chunk)
+            if reply and len(reply) >= 4 and reply[0] == 1 and crc16(reply[:-2]) == reply[-2] | (reply[-1] << 8):
+                status = reply[1]
+                return SERIAL_STATUS_NAMES[status] if status < len(SERIAL_STATUS_NAMES) else str(status)
+    sys.exit("no reply from " + port)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("program", nargs="?", help="program to assemble; stdin if omitted")
+    parser.add_argument("--leds", type=int, required=True, help="length of the longest strip the program will run on")
+    parser.add_argument("--name", default="patternProgram", help="name of the C array")
+    parser.add_argument("--port", help="serial port to upload the program to")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--slot", type=int, default=0, help="EEPROM slot to upload to")
+    args = parser.parse_args()
+
+    ops = load_ops(os.path.join(ROOT, "patternVM.h"))
+    config = os.path.join(ROOT, "config.h")
+    budget = load_define(config, "MW_PATTERN_CYCLE_BUDGET")
+    max_size = load_define(config, "MW_PATTERN_PROGRAM_SIZE")
+
+    source = open(args.program).read() if args.program else sys.stdin.read()
+    code = assemble(source, ops)
+    if len(code) > max_size:
+        sys.exit("program is %d bytes, over MW_PATTERN_PROGRAM_SIZE (%d)" % (len(code), max_size))
+
+    cycles = estimate_cycles(code, ops, args.leds, budget)
+    if cycles > budget:
+        sys.exit("program may take over MW_PATTERN_CYCLE_BUDGET (%d cycles) per frame on %d LEDs" % (budget, args.leds))
+    print("// %d bytes, up to %d cycles per frame on %d LEDs" % (len(code), cycles, args.leds), file=sys.stderr)
+
+    if args.port:
+        print(upload(code, args.port, args.baud, args.slot))
+    else:
+        print("const byte %s[] PROGMEM = {%s};" % (args.name, ", ".join(str(b) for b in code)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+"""
+Check a capture of the replay harness (replay.h) against a golden replay log.
+
+Reads the Serial output of a firmware built with MW_REPLAY (a file, stdin, or a serial port with --port, which needs
+pyserial), keeps only the replay's own lines ("frame <n> t=<ms>: ..." and "Replay done: ..."; anything else, e.g. log
+frames, is skipped), and compares them with the golden log, frame by frame. Exits with 1 and lists the first
+differences, by frame and light, if any frame or its timing changed; light names are read from the LightRegistry in
+MW3.ino.
+
+The golden log is host/replay.golden, recorded by the host build (host/Makefile), whose FastLED shim computes the same
+pixels as the real library. After a change that is meant to change the output, record a new one with --update, and
+commit it with the change.
+
+    host/build/replay | tools/replay_diff.py
+    tools/replay_diff.py --port /dev/ttyACM0
+    host/build/replay | tools/replay_diff.py --update
+"""
+
+import argparse
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
+FRAME_LINE = re.compile(rb"frame (\d+) t=(\d+):((?: [0-9A-F]+/\d+)*)")
+DONE_LINE = re.compile(rb"Replay done: \d+ frames, crc=[0-9A-F]+")
+
+MAX_DIFFERENCES = 10
+
+
+def load_light_names(sketch):
+    """Return the names of the lights, in LightRegistry order."""
+    with open(sketch) as f:
+        source = f.read()
+    registry = re.search(r"typedef LightRegistry<(.*?)> Lights;", source, re.S)
+    if not registry:
+        sys.exit("Lights registry not found in " + sketch)
+    return re.findall(r"LIGHT_ENTRY\((\w+)\)", registry.group(1))
+
+
+def replay_lines(source):
+    """Yield the replay's lines in a capture, as text, up to and including "Replay done"."""
+    for raw in source:
+        frame = FRAME_LINE.search(raw)
+        if frame:
+            yield frame.group(0).decode("ascii")
+            continue
+        done = DONE_LINE.search(raw)
+        if done:
+            yield done.group(0).decode("ascii")
+            return
+
+
+def parse_frame(line):
+    """Split a frame line into (frame number, time, [light outputs])."""
+    header, lights = line.split(":", 1)
+    number, time = header.split(" ")[1:]
+    return number, time, lights.split()
+
+
+def describe(golden, captured, lights):
+    """Say how a captured line differs from the golden one."""
+    if not golden.startswith("frame ") or not captured.startswith("frame "):
+        return "expected '%s', got '%s'" % (golden, captured)
+    g_number, g_time, g_lights = parse_frame(golden)
+    c_number, c_time, c_lights = parse_frame(captured)
+    if g_time != c_time:
+        return "frame %s at %s, expected at %s" % (c_number, c_time[2:], g_time[2:])
+    changed = []
+    for i, (g, c) in enumerate(zip(g_lights, c_lights)):
+        if g != c:
+            name = lights[i] if i < len(lights) else "light %d" % i
+            changed.append("%s %s (expected %s)" % (name, c, g))
+    if len(g_lights) != len(c_lights):
+        changed.append("%d lights (expected %d)" % (len(c_lights), len(g_lights)))
+    return "frame %s: %s" % (c_number, ", ".join(changed))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", nargs="?", help="file to check; stdin if omitted")
+    parser.add_argument("--port", help="serial port to read from instead")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--golden", default=os.path.join(ROOT, "host", "replay.golden"))
+    parser.add_argument("--sketch", default=os.path.join(ROOT, "MW3.ino"))
+    parser.add_argument("--update", action="store_true", help="write the capture to the golden log instead")
+    args = parser.parse_args()
+
+    if args.port:
+        import serial  # pyserial
+        source = serial.Serial(args.port, args.baud)
+    elif args.capture:
+        source = open(args.capture, "rb")
+    else:
+        source = sys.stdin.buffer
+
+    captured = list(replay_lines(source))
+    if not captured or not captured[-1].startswith("Replay done"):
+        sys.exit("capture has no complete replay (%d frames, no 'Replay done' line)" % len(captured))
+
+    if args.update:
+        with open(args.golden, "w") as f:
+            f.write("\n".join(captured) + "\n")
+        print("%s: %d frames" % (args.golden, len(captured) - 1))
+        return
+
+    with open(args.golden) as f:
+        golden = f.read().splitlines()
+    lights = load_light_names(args.sketch)
+
+    differences = [describe(g, c, lights) for g, c in zip(golden, captured) if g != c]
+    if len(golden) != len(captured):
+        differences.append("%d frames, expected %d" % (len(captured) - 1, len(golden) - 1))
+
+    if not differences:
+        print("replay matches %s: %d frames" % (os.path.relpath(args.golden), len(golden) - 1))
+        return
+    for difference in differences[:MAX_DIFFERENCES]:
+        print(difference)
+    if len(differences) > MAX_DIFFERENCES:
+        print("... %d more differences" % (len(differences) - MAX_DIFFERENCES))
+    sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
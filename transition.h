@@ -0,0 +1,91 @@
+#pragma once
+
+#include <FastLED.h>
+
+#include "clock.h"
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Crossfades between what a light showed and what it shows next, when its pattern or color changes.
+// When a transition starts, the light's current output is snapshotted; over the transition, every frame of the new
+// render is blended with that snapshot, going from all snapshot to all new.
+// The snapshot only keeps SnapshotPixels pixels, evenly sampled along the light, and stretched back over it when blending,
+// so a long strip doesn't need a second full frame buffer. The outgoing frame is frozen, not kept animating: over the
+// duration of a fade, the difference doesn't show, and the outgoing pattern doesn't have to keep rendering.
+//
+// Durations are given in MW_TRANSITION_UNIT ms, so they fit in a byte on tags; 0 cuts straight to the new output.
+// ----------------------------------------------------------------
+template <uint16_t SnapshotPixels>
+class Transition
+{
+  CRGB _snapshot[SnapshotPixels];
+  uint32_t _start = 0;
+  uint16_t _duration = 0; // ms; 0 when not transitioning
+
+  void start(byte iDuration)
+  {
+    _start = clockMillis();
+    _duration = iDuration * MW_TRANSITION_UNIT;
+  }
+
+public:
+  bool active() const { return _duration != 0; }
+
+  /**
+   * Start a transition from iLEDs, iNumLEDs pixels, now. Restarting a running transition fades from what's shown at that point.
+   */
+  void begin(const CRGB* iLEDs, uint16_t iNumLEDs, byte iDuration)
+  {
+    for (uint16_t i = 0; i < SnapshotPixels; ++i)
+      _snapshot[i] = iLEDs[(uint32_t)i * iNumLEDs / SnapshotPixels];
+    start(iDuration);
+  }
+
+  /**
+   * Start a transition from a solid color.
+   */
+  void begin(const CRGB& iColor, byte iDuration)
+  {
+    for (uint16_t i = 0; i < SnapshotPixels; ++i)
+      _snapshot[i] = iColor;
+    start(iDuration);
+  }
+
+  /**
+   * Blend the snapshot into ioLEDs, a new frame of iNumLEDs pixels, as of iNow; ends the transition once it's over.
+   */
+  void blend(CRGB* ioLEDs, uint16_t iNumLEDs, uint32_t iNow)
+  {
+    uint32_t elapsed = iNow - _start;
+    if (elapsed >= _duration)
+    {
+      _duration = 0;
+      return;
+    }
+    byte amount = ((uint32_t)elapsed << 8) / _duration; // of the new frame
+
+    // scale the snapshot once, rather than each pixel it's stretched over
+    CRGB faded[SnapshotPixels];
+    for (uint16_t i = 0; i < SnapshotPixels; ++i)
+    {
+      faded[i] = _snapshot[i];
+      nscale8x3(faded[i].r, faded[i].g, faded[i].b, 255 - amount);
+    }
+
+    // pixel i maps to snapshot pixel i * SnapshotPixels / iNumLEDs, stepped without dividing
+    uint16_t j = 0;
+    uint16_t error = 0;
+    for (uint16_t i = 0; i < iNumLEDs; ++i)
+    {
+      nscale8x3(ioLEDs[i].r, ioLEDs[i].g, ioLEDs[i].b, amount);
+      ioLEDs[i] += faded[j];
+
+      error += SnapshotPixels;
+      if (error >= iNumLEDs)
+      {
+        error -= iNumLEDs;
+        ++j;
+      }
+    }
+  }
+};